@@ -0,0 +1,119 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Andy Young
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "object_cacher.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+// every heap allocation of the process is counted, the fetch/return loop must not add any
+static unsigned long allocations = 0;
+
+void* operator new(size_t size)
+{
+  allocations++;
+  void* p = malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+/**
+ * @brief BenchObject, stands for a texture, keyed by size and two packed attributes
+ */
+class BenchObject final : public Cacheable {
+public:
+  struct Attributes : Cacheable::Attributes {
+    int format_ = 0;
+    int filter_ = 0;
+
+    inline void fill_key(Key& key) const override {
+      key.attributes_[0] = (uint64_t) (uint32_t) format_ << 32 | (uint32_t) filter_;
+    }
+  };
+
+  static BenchObject* create(int width, int height, Cacheable::Attributes* attributes) {
+    return new BenchObject(width, height, (Attributes*) attributes);
+  }
+
+  BenchObject(int width, int height, Attributes* attributes) : attributes_(*attributes) {
+    width_ = width;
+    height_ = height;
+  }
+
+  size_t get_byte_size() const override { return (size_t) width_ * height_ * 4; }
+  Cacheable::Attributes* get_attributes() const override { return (Cacheable::Attributes*) &attributes_; }
+
+private:
+  Attributes attributes_;
+};
+
+static const int NUM_KEYS = 8;   // sizes and formats alive at once, e.g. a few renderers
+static const int NUM_HELD = 3;   // objects of a key fetched out together, e.g. a pbo ring
+static const int ITERATIONS = 1000000;
+
+static void run(const char* name, ObjectCacher<BenchObject>& cacher)
+{
+  BenchObject::Attributes attributes[NUM_KEYS];
+  for (int i = 0; i < NUM_KEYS; i++) {
+    attributes[i].format_ = i % 4;
+    attributes[i].filter_ = i / 4;
+  }
+  BenchObject* held[NUM_HELD];
+
+  auto loop = [&](int iterations) {
+    for (int n = 0; n < iterations; n++) {
+      int k = n % NUM_KEYS;
+      int width = 640 + (k & 1) * 640;
+      for (int i = 0; i < NUM_HELD; i++) held[i] = cacher.fetch_object(width, 480, &attributes[k]);
+      for (int i = 0; i < NUM_HELD; i++) cacher.return_object(held[i]);
+    }
+  };
+
+  loop(NUM_KEYS); // warm up, creates the objects and free-lists
+  unsigned long allocations_before = allocations;
+  auto start = std::chrono::steady_clock::now();
+  loop(ITERATIONS);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+  ObjectCacher<BenchObject>::Stats stats = cacher.get_stats();
+  printf("%-10s %8.1f ns per fetch/return, %lu allocations, %lu hits, %lu misses, %lu evictions\n",
+         name, ns / ((double) ITERATIONS * NUM_HELD), allocations - allocations_before,
+         stats.hits_, stats.misses_, stats.evictions_);
+}
+
+int main()
+{
+  ObjectCacher<BenchObject> unlimited;
+  run("unlimited", unlimited);
+
+  // room for everything held at once, the budget is checked on each return but never hit
+  ObjectCacher<BenchObject> budgeted;
+  budgeted.set_budget((size_t) NUM_KEYS * NUM_HELD * 1280 * 480 * 4);
+  run("budgeted", budgeted);
+  return 0;
+}
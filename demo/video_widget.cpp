@@ -6,6 +6,7 @@
 #include "screen_capturer.h"
 #include "window_capturer.h"
 #include "composite_capturer.h"
+#include <cstdio>
 
 #include <wayland-egl-core.h>
 #include <qpa/qplatformnativeinterface.h>
@@ -17,6 +18,7 @@ VideoWidget::VideoWidget(QWidget *parent) : QWidget{parent}
   setAttribute(Qt::WA_NoSystemBackground);
 
   mRenderCtrl = new RenderCtrl();
+  mRenderCtrl->set_render_mode(RenderCtrl::RENDER_MODE_ON_FRAME);
   mGLRenderer = new GLRenderer(mRenderCtrl);
   mRenderCtrl->start();
   timer = new QTimer(this);
@@ -72,7 +74,10 @@ void VideoWidget::selectDevice()
   capDevice->bind_device(dev);
   capDevice->start_device();
   DeviceInfo& info = capDevice->get_cur_device();
-  mGLRenderer->set_texture_format(info.format_);
+  if (mGLRenderer->set_texture_format(info.format_) < 0) {
+    fprintf(stderr, "Pixel format %d of %s can not be drawn\n", info.format_, info.name_.c_str());
+  }
+  mGLRenderer->set_color_space(info.color_space_, info.color_range_);
 }
 
 QPaintEngine* VideoWidget::paintEngine() const
@@ -105,10 +110,10 @@ void VideoWidget::_feedData()
     return;
 
   unsigned char* pixels = nullptr;
-  if (capDevice->grab_frame(pixels) > 0) {
+  if (capDevice->grab_frame(pixels, dirtyRects) > 0) {
     int texWidth = capDevice->get_cur_device().width_;
     int texHeight = capDevice->get_cur_device().height_;
-    mGLRenderer->upload_texture(&pixels, 1, texWidth, texHeight);
+    mGLRenderer->upload_texture(&pixels, 1, texWidth, texHeight, dirtyRects);
   }
 }
 
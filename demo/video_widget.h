@@ -38,6 +38,7 @@ private:
 
   ICaptureDevice* capDevice = nullptr;
   ICaptureDevice* winCapturer = nullptr;
+  std::vector<Rect> dirtyRects;
 };
 
 #endif // VIDEOWIDGET_H
@@ -24,51 +24,57 @@
 #ifndef IMAGE_PROC_CACHEABLE_H
 #define IMAGE_PROC_CACHEABLE_H
 
-#include <string>
-#include <cstring>
-#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
 
-std::string inline str_format(const char *fmt, ...) {
-  std::string str_result = "";
-  if (nullptr != fmt) {
-    va_list marker;
-    va_start(marker, fmt);
-
-    char *buf = nullptr;
-    int result = vasprintf(&buf, fmt, marker);
+class Cacheable {
+public:
+  /**
+   * @brief Key, objects of equal keys are interchangeable in a cache,
+   *        plain data so that looking one up never allocates
+   */
+  struct Key {
+    int width_ = 0;
+    int height_ = 0;
+    uint64_t attributes_[2] = {0, 0}; // packed by Attributes::fill_key
 
-    if (nullptr == buf) {
-      va_end(marker);
-      return str_result;
+    inline bool operator==(const Key& other) const {
+      return width_ == other.width_ && height_ == other.height_
+          && attributes_[0] == other.attributes_[0] && attributes_[1] == other.attributes_[1];
     }
+  };
 
-    if (result < 0) {
-      free(buf);
-      va_end(marker);
-      return str_result;
+  struct KeyHash {
+    inline size_t operator()(const Key& key) const {
+      uint64_t hash = ((uint64_t) (uint32_t) key.width_ << 32) | (uint32_t) key.height_;
+      hash ^= key.attributes_[0] + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+      hash ^= key.attributes_[1] + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+      return (size_t) hash;
     }
+  };
 
-    result = (int)strlen(buf);
-    str_result.append(buf, result);
-    free(buf);
-    va_end(marker);
-  }
-  return str_result;
-}
-
-class Cacheable {
-public:
   struct Attributes {
-    virtual std::string get_hash() const { return ""; }
+    /**
+     * @brief fill_key, pack every field telling objects apart into key.attributes_
+     */
+    virtual void fill_key(Key&) const {}
   };
 
-  static Cacheable* create(int width, int height, Attributes* attribute) { return nullptr; }
+  static Cacheable* create(int, int, Attributes*) { return nullptr; }
 
-  static inline std::string get_hash(int width, int height, const Attributes* attributes) {
-    return str_format("%.1dx%.1d-%s", width, height, attributes->get_hash().c_str());
+  static inline Key get_key(int width, int height, const Attributes* attributes) {
+    Key key;
+    key.width_ = width;
+    key.height_ = height;
+    attributes->fill_key(key);
+    return key;
   }
 
   virtual bool need_be_cached() { return true; };
+  /**
+   * @brief get_byte_size, memory held by the object, accounted against the budget of a cache
+   */
+  virtual size_t get_byte_size() const { return 0; }
   virtual Attributes* get_attributes() const = 0;
   int get_width() const { return width_; }
   int get_height() const { return height_; }
@@ -26,6 +26,18 @@
 
 #include "capture_interface.h"
 #include "v4l2.h"
+#include "mjpeg_decoder.h"
+#include "frame.h"
+#include <mutex>
+
+class CameraWatcher;
+
+struct CameraMode {
+  PixelFormat format_;
+  int width_ = 0;
+  int height_ = 0;
+  int fps_ = 0;
+};
 
 class CameraDevice : public ICaptureDevice
 {
@@ -33,22 +45,139 @@ public:
   CameraDevice();
   ~CameraDevice();
 
+  /**
+   * @brief enum_devices, video nodes are listed from sysfs and only queried (never mapped),
+   *        results are cached until invalidate_devices is called
+   */
   const std::vector<DeviceInfo> enum_devices() override;
+  static void invalidate_devices();
   int bind_device(DeviceInfo info) override;
   int unbind_device() override;
   int start_device() override;
   int stop_device() override;
+  using ICaptureDevice::grab_frame;
   int grab_frame(unsigned char* &buffer) override;
+  /**
+   * @brief grab_frame, the mmapped buffer is lent as a Frame without copying, it is given back
+   *        to driver in the capturing thread after the last reference is released,
+   *        such frames must be released before stop_device which unmaps the buffers,
+   *        decoded MJPEG frames are copied into pooled frames instead
+   */
+  int grab_frame(Frame* &frame) override;
   /**
    * @brief set_preview_size, must be called before start_device
    * @param width
    * @param height
    */
   void set_preview_size(int width, int height);
+  /**
+   * @brief enum_modes, formats/sizes/frame rates supported by the bound device,
+   *        formats which can't be mapped to PixelFormat are left out
+   */
+  std::vector<CameraMode> enum_modes();
+  /**
+   * @brief set_capture_mode, request format, size and frame rate, must be called before start_device,
+   *        YUYV is requested if it is never called,
+   *        driver may adjust them, check get_cur_device after start_device for the result
+   * @param mode, fps_ of 0 keeps the frame rate of driver
+   */
+  void set_capture_mode(const CameraMode& mode);
+  /**
+   * @brief get_frame_rate, frame rate negotiated with driver, 0 if unknown
+   */
+  int get_frame_rate();
+  /**
+   * @brief set_buffer_count, number of capture buffers, must be called before start_device
+   * @param count
+   */
+  void set_buffer_count(int count);
+  /**
+   * @brief wait_frame, block until driver completes a buffer
+   * @param timeout_ms, negative value stands for waiting infinitely
+   * @return 1 for frame ready, 0 for timeout, negative value if error occurred
+   */
+  int wait_frame(int timeout_ms);
+  /**
+   * @brief borrow_frame, get the mmapped buffer of a new frame without copying,
+   *        the buffer won't be refilled by driver until release_frame is called
+   * @param buffer, pointer will be set to the mmapped buffer
+   * @param length, will be set to the length of the frame
+   * @return index of the buffer (>= 0), value smaller than 0 means no frame available
+   */
+  int borrow_frame(unsigned char* &buffer, int &length);
+  int release_frame(int index);
+  /**
+   * @brief drop_frame, give a completed buffer back to driver unread, for a consumer
+   *        which can not take it now (frames lent out or decoder busy)
+   * @return 1 if a frame has been dropped, 0 if none was ready, negative value if error occurred
+   */
+  int drop_frame();
+  /**
+   * @brief set_max_borrowed_frames, frames a consumer may hold at the same time,
+   *        at least one buffer is always kept queued for the driver
+   * @param count
+   */
+  void set_max_borrowed_frames(int count);
+  /**
+   * @brief set_dmabuf_export, export capture buffers as dmabuf, must be called before start_device
+   * @param is_enable
+   */
+  void set_dmabuf_export(bool is_enable) { is_dmabuf_export_ = is_enable; }
+  /**
+   * @brief set_mjpeg_decode, decode MJPEG frames to I420 in grab_frame, must be called before start_device,
+   *        format of current device turns into PIXEL_FORMAT_I420 once MJPEG is negotiated
+   * @param is_enable
+   * @param is_threaded, decode in a worker thread, grab_frame then returns the frame
+   *        decoded from the previous grab, so one frame of latency is added
+   */
+  void set_mjpeg_decode(bool is_enable, bool is_threaded = false);
+  /**
+   * @brief get_dmabuf_fd, dmabuf of a buffer got from grab_frame/borrow_frame
+   * @param index, index of buffer, -1 stands for the one of the last grab_frame
+   * @return fd, -1 if buffers are not exported
+   */
+  int get_dmabuf_fd(int index = -1);
+  int get_bytes_per_line();
+  /**
+   * @brief get_fd, fd of the opened device for polling, -1 if not started
+   */
+  int get_fd();
 
 private:
-  PixelFormat get_pixel_format(v4l2_format_t& format);
+  static void load_devices();
+  static bool probe_device(const std::string& node, DeviceInfo& dev);
+  static bool add_cached_device(const std::string& node, DeviceInfo& dev);
+  static bool remove_cached_device(const std::string& node, DeviceInfo& dev);
+  int grab_decoded_frame(unsigned char* &buffer);
+  void requeue_lent_frames();
+  void release_decoder();
+  static bool get_pixel_format(unsigned int fourcc, PixelFormat& format);
+  static unsigned int get_fourcc(PixelFormat format);
+  static void get_color_space(v4l2_format_t& format, DeviceInfo& dev);
   v4l2_device_t* v4l2_cam_ = nullptr;
+  int max_borrowed_frames_ = 2;
+  int buffer_count_ = V4L2_DEFAULT_BUFFERS;
+  unsigned int req_fourcc_ = V4L2_PIX_FMT_YUYV; // YUYV unless set_capture_mode asks for another
+  int req_fps_ = 0;
+  int grabbed_index_ = -1;
+  bool is_dmabuf_export_ = false;
+  bool is_mjpeg_decode_ = false;
+  bool is_mjpeg_threaded_ = false;
+  MjpegDecoder* mjpeg_decoder_ = nullptr;
+  DecodedFrame decoded_frame_;
+
+  // buffers lent out as Frame and released, requeued in capturing thread
+  struct LentFrames {
+    std::mutex mutex_;
+    std::vector<int> released_;
+    int generation_ = 0; // bumped on stop, releases of older frames are dropped
+  };
+  std::shared_ptr<LentFrames> lent_frames_ = std::make_shared<LentFrames>();
+
+  static std::mutex s_device_mutex_;
+  static std::vector<DeviceInfo> s_devices_;
+  static bool s_is_devices_valid_;
+  friend CameraWatcher;
 };
 
 #endif // CAMERA_DEVICE_H
@@ -0,0 +1,78 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Andy Young
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef CAMERA_GROUP_H
+#define CAMERA_GROUP_H
+
+#include "camera_device.h"
+#include <pthread.h>
+#include <functional>
+#include <mutex>
+#include <map>
+
+/**
+ * @brief CameraGroup, captures many started cameras in one thread by waiting
+ *        on all of their fds with a single epoll
+ */
+class CameraGroup
+{
+public:
+  /**
+   * @brief FrameCallback, called in capture thread for every frame grabbed,
+   *        buffer stays valid until the next frame of the same camera,
+   *        frames completed while camera can not hand out one are dropped,
+   *        length smaller than 0 means camera failed and has been removed from group
+   */
+  typedef std::function<void(CameraDevice* camera, unsigned char* buffer, int length)> FrameCallback;
+
+  CameraGroup();
+  ~CameraGroup();
+
+  /**
+   * @brief add_camera, camera must have been started
+   * @return 0 for success, negative value if camera is not capturing
+   */
+  int add_camera(CameraDevice* camera, FrameCallback callback);
+  /**
+   * @brief remove_camera, no callback of the camera runs after return,
+   *        must not be called inside a FrameCallback
+   */
+  int remove_camera(CameraDevice* camera);
+
+  void start();
+  void stop();
+
+private:
+  static void* capture_loop(void* data);
+  void dispatch_frame(CameraDevice* camera, unsigned int events);
+
+  int epoll_fd_ = -1;
+  int wakeup_fd_ = -1;
+  pthread_t capture_thread_;
+  volatile bool is_running_ = false;
+
+  std::mutex camera_mutex_;
+  std::map<CameraDevice*, FrameCallback> cameras_;
+};
+
+#endif // CAMERA_GROUP_H
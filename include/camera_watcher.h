@@ -0,0 +1,65 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Andy Young
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef CAMERA_WATCHER_H
+#define CAMERA_WATCHER_H
+
+#include "camera_device.h"
+#include <pthread.h>
+#include <functional>
+
+/**
+ * @brief CameraWatcher, reports cameras plugged in or out by watching video nodes in /dev
+ *        with inotify, the device list cached by CameraDevice is updated incrementally
+ */
+class CameraWatcher
+{
+public:
+  enum EventType
+  {
+    EVENT_TYPE_ADDED = 0,
+    EVENT_TYPE_REMOVED,
+  };
+  /**
+   * @brief EventCallback, called in watcher thread
+   */
+  typedef std::function<void(EventType type, const DeviceInfo& dev)> EventCallback;
+
+  CameraWatcher();
+  ~CameraWatcher();
+
+  int start(EventCallback callback);
+  void stop();
+
+private:
+  static void* watch_loop(void* data);
+  void process_events();
+
+  int inotify_fd_ = -1;
+  int wakeup_fd_ = -1;
+  pthread_t watch_thread_;
+  volatile bool is_running_ = false;
+  EventCallback callback_;
+};
+
+#endif // CAMERA_WATCHER_H
@@ -26,17 +26,40 @@
 
 #include <vector>
 #include <string>
+#include <cstring>
+#include <memory>
 
 enum PixelFormat {
   PIXEL_FORMAT_RGBA = 0,
   PIXEL_FORMAT_RGB,
   PIXEL_FORMAT_I420,
   PIXEL_FORMAT_NV21,
-  PIXEL_FORMAT_YUYV
+  PIXEL_FORMAT_YUYV,
+  PIXEL_FORMAT_NV12,
+  PIXEL_FORMAT_MJPEG
+};
+
+enum ColorSpace {
+  COLOR_SPACE_BT601 = 0,
+  COLOR_SPACE_BT709
+};
+
+enum ColorRange {
+  COLOR_RANGE_LIMITED = 0,
+  COLOR_RANGE_FULL
+};
+
+struct Rect {
+  int x_ = 0;
+  int y_ = 0;
+  int width_ = 0;
+  int height_ = 0;
 };
 
 struct DeviceInfo {
   PixelFormat format_;
+  ColorSpace color_space_ = COLOR_SPACE_BT601; // of yuv formats
+  ColorRange color_range_ = COLOR_RANGE_FULL;
   int pos_x_ = 0;
   int pos_y_ = 0;
   int width_ = 0;
@@ -46,6 +69,29 @@ struct DeviceInfo {
   u_int8_t* ext_data_ = nullptr;
 };
 
+class Frame;
+class FramePool;
+
+/**
+ * @brief IBufferProvider, memory where a consumer wants frames to be written (e.g. a mapped pbo),
+ *        capturers copy into it instead of handing out their own buffer
+ */
+class IBufferProvider
+{
+public:
+  /**
+   * @brief acquire_buffer, may be called from capturing thread
+   * @return buffer of length bytes, nullptr if nothing is available for the length now
+   */
+  virtual unsigned char* acquire_buffer(int length) = 0;
+  /**
+   * @brief commit_buffer, buffer from acquire_buffer has been filled with a frame,
+   *        length smaller than or equal to 0 gives it back untouched
+   */
+  virtual void commit_buffer(unsigned char* buffer, int length) = 0;
+  virtual ~IBufferProvider() { }
+};
+
 class ICaptureDevice
 {
 public:
@@ -63,11 +109,59 @@ public:
    *         value smaller than 0 means some exception occurred
    */
   virtual int grab_frame(unsigned char* &buffer) = 0;
+  /**
+   * @brief grab_frame, get buffer of the updated frame and the areas updated in it
+   * @param buffer, pointer will be set to the pixel buffer of the whole frame
+   * @param dirty, will be filled with the updated rectangles (in frame coordinates)
+   * @return value equals 0 stands for nothing changed (no need to render),
+   *         value bigger than 0 is the length of updated pixels of all rectangles,
+   *         value smaller than 0 means some exception occurred
+   */
+  virtual int grab_frame(unsigned char* &buffer, std::vector<Rect>& dirty) {
+    dirty.clear();
+    int len = grab_frame(buffer);
+    if (len > 0) {
+      Rect frame;
+      frame.width_ = get_cur_device().width_;
+      frame.height_ = get_cur_device().height_;
+      dirty.push_back(frame);
+    }
+    return len;
+  }
+  /**
+   * @brief grab_frame, get the updated frame as a Frame owned by caller (one reference),
+   *        capturer never writes into it again, so it can be handed to another thread
+   *        (e.g. GLRenderer::upload_frame) without tearing. By default the frame is copied
+   *        into a pooled Frame, capturers able to lend their buffers override it
+   * @return same as grab_frame(buffer), frame is set only when value is bigger than 0
+   */
+  virtual int grab_frame(Frame* &frame);
   virtual DeviceInfo& get_cur_device() { return cur_dev_; }
+  /**
+   * @brief set_buffer_provider, whole frames from grab_frame(buffer) are written into buffers
+   *        of provider when it has one, buffer then points into provider memory and the frame
+   *        has been committed already, capturers not supporting it just ignore the provider
+   */
+  virtual void set_buffer_provider(IBufferProvider* provider) { buffer_provider_ = provider; }
   virtual ~ICaptureDevice() { unbind_device(); }
 
 protected:
+  /**
+   * @brief deliver_to_provider, copy a whole frame into provider memory
+   * @return buffer of provider holding the frame, the given buffer if provider has none
+   */
+  unsigned char* deliver_to_provider(unsigned char* buffer, int length) {
+    if (!buffer_provider_ || length <= 0) return buffer;
+    unsigned char* dest = buffer_provider_->acquire_buffer(length);
+    if (!dest) return buffer;
+    memcpy(dest, buffer, length);
+    buffer_provider_->commit_buffer(dest, length);
+    return dest;
+  }
+
   DeviceInfo cur_dev_;
+  IBufferProvider* buffer_provider_ = nullptr;
+  std::shared_ptr<FramePool> frame_pool_;
 };
 
 #endif // CAPTURE_DEVICE_H
@@ -0,0 +1,41 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Andy Young
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef COLOR_SPACE_H
+#define COLOR_SPACE_H
+
+#include "capture_interface.h"
+
+/**
+ * @brief get_yuv_to_rgb_coefficients, conversion in form of rgb = matrix * (yuv - offset),
+ *        yuv and rgb normalized to [0, 1], shared by shaders and cpu conversions
+ * @param matrix, 3x3 in column major (as glUniformMatrix3fv takes it)
+ * @param offset, 3 floats
+ */
+void get_yuv_to_rgb_coefficients(ColorSpace space, ColorRange range, float matrix[9], float offset[3]);
+/**
+ * @brief get_rgb_to_yuv_coefficients, inverse of the above in form of yuv = matrix * rgb + offset
+ */
+void get_rgb_to_yuv_coefficients(ColorSpace space, ColorRange range, float matrix[9], float offset[3]);
+
+#endif // COLOR_SPACE_H
@@ -25,6 +25,7 @@
 #define COMPOSITE_CAPTURER_H
 
 #include "cursor_capturer.h"
+#include <vector>
 
 class CompositeCapturer : public ICaptureDevice
 {
@@ -36,13 +37,28 @@ public:
   int bind_device(DeviceInfo dev) override;
   int unbind_device() override;
   DeviceInfo& get_cur_device() override;
+  using ICaptureDevice::grab_frame;
   int grab_frame(unsigned char* &buffer) override;
+  int grab_frame(unsigned char* &buffer, std::vector<Rect>& dirty) override;
   void set_enable_cursor(bool is_enable) { is_cursor_enabled_ = is_enable; }
+  /**
+   * @brief set_buffer_provider, frames are delivered after cursor blending,
+   *        so the provider is kept here rather than passed to the window capturer
+   */
+  void set_buffer_provider(IBufferProvider* provider) override;
 
 private:
+  void restore_cursor_background();
+  void blend_cursor(unsigned char* buffer, unsigned char* cursor_buffer);
+
   ICaptureDevice* window_cap_device_ = nullptr;
   CursorCapturer* cursor_cap_device_ = nullptr;
   bool      is_cursor_enabled_ = true;
+
+  // window pixels covered by the last blended cursor
+  std::vector<int> cursor_background_;
+  unsigned char* blended_buffer_ = nullptr;
+  Rect background_rect_;
 };
 
 #endif // COMPOSITE_CAPTURER_H
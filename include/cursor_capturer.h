@@ -36,6 +36,7 @@ public:
   const std::vector<DeviceInfo> enum_devices() override;
   int bind_device(DeviceInfo dev) override;
   int unbind_device() override;
+  using ICaptureDevice::grab_frame;
   int grab_frame(unsigned char* &buffer) override;
   int get_hot_spot(int &x, int &y);
 private:
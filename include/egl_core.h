@@ -25,6 +25,7 @@
 #define FILTER_EGL_CORE_H
 
 #include <EGL/egl.h>
+#include <EGL/eglext.h>
 
 /**
  * Constructor flag: surface must be recordable.  This discourages EGL from using a
@@ -82,11 +83,22 @@ public:
   // 获取当前的GLES 版本号
   int get_gl_version();
 
+  // 是否支持某个EGL扩展
+  bool has_extension(const char* extension);
+
+  // 从dmabuf创建EGLImage (EGL_EXT_image_dma_buf_import)
+  EGLImageKHR create_dmabuf_image(int fd, int width, int height, int fourcc, int offset, int pitch);
+
+  // 销毁EGLImage
+  void release_image(EGLImageKHR image);
+
 private:
   EGLDisplay egl_display_ = EGL_NO_DISPLAY;
   EGLConfig egl_config_ = NULL;
   EGLContext egl_context_ = EGL_NO_CONTEXT;
   int gl_version_ = -1;
+  PFNEGLCREATEIMAGEKHRPROC create_image_ = nullptr;
+  PFNEGLDESTROYIMAGEKHRPROC destroy_image_ = nullptr;
 
   // 查找合适的EGLConfig
   EGLConfig get_config(int flags, int version);
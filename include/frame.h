@@ -0,0 +1,121 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Andy Young
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "capture_interface.h"
+#include "object_cacher.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+
+class FramePool;
+
+/**
+ * @brief Frame, pixels of one captured frame passed from capturer to renderer by reference,
+ *        whoever holds a reference may read it, the last release returns it to its pool
+ *        (or runs the release hook of wrapped memory)
+ */
+class Frame : public Cacheable {
+public:
+  struct Attributes : Cacheable::Attributes {
+    PixelFormat format_ = PIXEL_FORMAT_RGBA;
+    int stride_ = 0; // bytes per row of the first plane, 0 for tightly packed
+
+    inline void fill_key(Key& key) const override {
+      key.attributes_[0] = (uint64_t) (uint32_t) format_ << 32 | (uint32_t) stride_;
+    }
+  };
+
+  static Frame* create(int width, int height, Cacheable::Attributes* attributes);
+  /**
+   * @brief wrap, frame on memory owned by someone else (e.g. a mmapped v4l2 buffer)
+   * @param on_release, called once the last reference is dropped, may be in any thread
+   */
+  static Frame* wrap(unsigned char* data, int length, int width, int height,
+                     Attributes* attributes, std::function<void()> on_release);
+  /**
+   * @brief get_frame_length, bytes of a frame, chroma rows are half of stride for planar formats
+   */
+  static int get_frame_length(PixelFormat format, int width, int height, int stride = 0);
+
+  Frame(int width, int height, Attributes* attributes);
+  virtual ~Frame();
+
+  void add_ref() { ref_count_++; }
+  void release();
+
+  bool need_be_cached() override { return !on_release_; }
+  size_t get_byte_size() const override {
+    return get_frame_length(attributes_.format_, width_, height_, attributes_.stride_);
+  }
+  inline Cacheable::Attributes* get_attributes() const override { return (Cacheable::Attributes*) &attributes_; }
+
+  unsigned char* get_data() { return data_; }
+  int get_length() const { return length_; }
+  void set_length(int length) { length_ = length; }
+  PixelFormat get_format() const { return attributes_.format_; }
+  int get_stride() const { return attributes_.stride_; }
+  int64_t get_timestamp() const { return timestamp_us_; }
+  void set_timestamp(int64_t timestamp_us) { timestamp_us_ = timestamp_us; }
+
+private:
+  Attributes attributes_;
+  unsigned char* data_ = nullptr;
+  int length_ = 0;
+  int64_t timestamp_us_ = 0; // CLOCK_MONOTONIC
+  std::atomic<int> ref_count_;
+  std::function<void()> on_release_;
+  std::shared_ptr<FramePool> pool_; // only while frame is out of pool
+
+  friend FramePool;
+};
+
+/**
+ * @brief FramePool, recycles frames of the same size and layout,
+ *        stays alive as long as any frame of it is out
+ */
+class FramePool : public std::enable_shared_from_this<FramePool> {
+public:
+  static std::shared_ptr<FramePool> create() { return std::shared_ptr<FramePool>(new FramePool()); }
+
+  /**
+   * @brief acquire, frame with one reference owned by caller
+   */
+  Frame* acquire(int width, int height, PixelFormat format, int stride = 0);
+
+private:
+  FramePool() { }
+  void recycle(Frame* frame);
+
+  ObjectCacher<Frame, Frame::Attributes> cacher_;
+  friend Frame;
+};
+
+/**
+ * @brief get_monotonic_us, timestamp in the clock frames are stamped with
+ */
+int64_t get_monotonic_us();
+
+#endif // FRAME_H
@@ -0,0 +1,97 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Andy Young
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef FRAME_QUEUE_H
+#define FRAME_QUEUE_H
+
+#include "frame.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief FrameQueue, lock-free handoff of frames from one producer thread to one consumer thread,
+ *        references of frames move with them, frames dropped by policy are released
+ */
+class FrameQueue
+{
+public:
+  enum DropPolicy
+  {
+    DROP_POLICY_LATEST = 0, // one slot, a newer frame replaces the one not consumed yet
+    DROP_POLICY_QUEUE, // up to capacity frames in order, a frame pushed into full queue is dropped
+    DROP_POLICY_BLOCK, // up to capacity frames in order, producer waits while queue is full,
+                       // for block_timeout_ms at most, then the frame is dropped
+  };
+
+  FrameQueue(DropPolicy policy = DROP_POLICY_LATEST, int capacity = 1);
+  ~FrameQueue();
+
+  /**
+   * @brief set_policy, neither producer nor consumer may be running, frames queued are released
+   */
+  void set_policy(DropPolicy policy, int capacity, int block_timeout_ms = 100);
+  /**
+   * @brief push, producer side, reference of caller is taken over
+   * @return false if frame was dropped
+   */
+  bool push(Frame* frame);
+  /**
+   * @brief pop, consumer side, caller owns the reference of frame returned
+   * @return nullptr if nothing queued
+   */
+  Frame* pop();
+  /**
+   * @brief clear, consumer side, release frames queued, producer waiting is woken up
+   */
+  void clear();
+  /**
+   * @brief set_closed, while closed frames pushed are dropped at once, e.g. nobody consumes them
+   */
+  void set_closed(bool is_closed);
+
+  unsigned long get_pushed_frames() const { return pushed_frames_; }
+  unsigned long get_dropped_frames() const { return dropped_frames_; }
+
+private:
+  DropPolicy policy_ = DROP_POLICY_LATEST;
+  std::atomic<Frame*> latest_;
+
+  // ring keeps one slot empty to tell full from empty
+  std::vector<Frame*> slots_;
+  std::atomic<unsigned int> head_; // next slot to pop, written by consumer
+  std::atomic<unsigned int> tail_; // next slot to push, written by producer
+
+  // producer of DROP_POLICY_BLOCK sleeps here only while the ring is full
+  int block_timeout_ms_ = 100;
+  std::atomic<bool> is_closed_;
+  std::atomic<bool> is_producer_waiting_;
+  std::mutex wait_mutex_;
+  std::condition_variable wait_cv_;
+
+  std::atomic<unsigned long> pushed_frames_;
+  std::atomic<unsigned long> dropped_frames_;
+};
+
+#endif // FRAME_QUEUE_H
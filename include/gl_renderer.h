@@ -28,11 +28,15 @@
 #include "render_ctrl.h"
 #include "texture.h"
 #include "capture_interface.h"
+#include "frame_queue.h"
 #include <pthread.h>
+#include <sys/types.h>
+#include <functional>
+#include <map>
 
 class RenderCtrl;
 
-class GLRenderer
+class GLRenderer : public IBufferProvider
 {
 public:
 enum ScaleType
@@ -42,6 +46,13 @@ enum ScaleType
   SCALE_TYPE_CROP_FIT,
 };
 
+  /**
+   * @brief ConvertedFrameCallback, planes of one converted frame back to back, called in render thread,
+   *        data is valid during the call only
+   */
+  typedef std::function<void(const uint8_t* data, int length, int width, int height,
+                             PixelFormat format)> ConvertedFrameCallback;
+
 public:
   GLRenderer(RenderCtrl* render_ctrl);
   virtual ~GLRenderer();
@@ -49,9 +60,72 @@ public:
   void bind_window_for_source(void* win, std::string& src_id);
 
   int upload_texture(uint8_t** data, int num_channel, int width, int height);
+  /**
+   * @brief upload_texture, only the dirty rectangles of data will be uploaded,
+   *        data must stay a whole frame since partial uploads are applied on the last one
+   */
+  int upload_texture(uint8_t** data, int num_channel, int width, int height,
+                     const std::vector<Rect>& dirty);
+  /**
+   * @brief upload_frame, take over the reference of caller to frame, it is queued without locking
+   *        and released (back to its pool) once copied into a pbo or dropped by the queue policy,
+   *        should not be mixed with upload_texture in one renderer, frames whose format differs
+   *        from set_texture_format are dropped by render thread
+   * @return 0 for success, 1 if frame has been dropped, negative value if frame is null
+   */
+  int upload_frame(Frame* frame);
+  /**
+   * @brief set_frame_policy, how upload_frame behaves when frames come faster than rendering,
+   *        must be called before any frame is uploaded, latest frame wins by default
+   */
+  void set_frame_policy(FrameQueue::DropPolicy policy, int capacity = 1);
+  unsigned long get_dropped_frames() const { return frame_queue_.get_dropped_frames(); }
+  /**
+   * @brief upload_dmabuf, draw a YUYV frame straight from a dmabuf (e.g. exported v4l2 buffer)
+   *        through EGLImage, no cpu copy or pbo upload is involved
+   * @param fd, dmabuf of the frame, imported images are cached per buffer (not per fd number),
+   *        fd must stay open until the frame is drawn or replaced
+   * @param stride, bytes per line of the frame
+   * @return 0 for success, negative value if dmabuf import is not supported,
+   *         upload_texture should be used instead
+   */
+  int upload_dmabuf(int fd, int width, int height, int stride);
+  /**
+   * @brief drop_dmabuf_images, forget all imported dmabufs, to be called once the buffers
+   *        are gone (e.g. camera stopped or rebound), images are released by render thread
+   */
+  void drop_dmabuf_images();
+  /**
+   * @brief set_buffer_provided, keep a slot of the pbo ring mapped and hand it out through
+   *        acquire_buffer, so a capturer (see ICaptureDevice::set_buffer_provider) writes
+   *        whole frames straight into gpu visible memory, frames of other sizes than the
+   *        current one still go through upload_texture, no buffer is provided on GLES2
+   */
+  void set_buffer_provided(bool is_provided);
+  unsigned char* acquire_buffer(int length) override;
+  void commit_buffer(unsigned char* buffer, int length) override;
   void set_output_size(int width, int height);
-  void set_texture_format(PixelFormat format);
+  /**
+   * @brief set_texture_format, format of frames to be uploaded, must be called before setup
+   * @return -1 if format can not be drawn (RGB, MJPEG), nothing is drawn then
+   */
+  int set_texture_format(PixelFormat format);
+  static bool is_format_drawable(PixelFormat format);
+  /**
+   * @brief set_color_space, how yuv frames are converted to rgb, BT.601 full range by default
+   */
+  void set_color_space(ColorSpace space, ColorRange range);
   void set_scale_type(ScaleType type = SCALE_TYPE_SCALE_FIT);
+  /**
+   * @brief set_converted_output, convert each new rgba frame into NV12 or I420 on gpu as well and
+   *        read it back asynchronously, frames reach callback one or two frames later (GLES3 only),
+   *        width is rounded up to multiple of 4 (8 for I420), height of 2 (4 for I420),
+   *        filled by repeating the edge of frame
+   * @param callback, nullptr to stop converting
+   * @return -1 if format is neither NV12 nor I420
+   */
+  int set_converted_output(PixelFormat format, ColorSpace space, ColorRange range,
+                           ConvertedFrameCallback callback);
 
 protected:
   int setup();
@@ -61,10 +135,40 @@ protected:
   virtual int pre_draw();
   virtual int post_draw();
   int upload_texture_internal();
+  int upload_dirty_rects();
+  int import_dmabuf_internal();
+  void release_dmabuf_textures();
+  static Texture::Attributes get_yuyv_attributes();
   int check_texture_size(int width, int height);
+  void fetch_input_textures();
+  void return_input_textures();
+  void reset_tex_coords();
+  int get_frame_size();
   int setup_pixel_buffer();
+  void release_pixel_buffer();
+  struct PlaneLayout {
+    int src_offset_;
+    int src_stride_;
+    int dst_offset_;
+    int row_size_; // bytes of a row, rows are packed in pbo
+    int rows_;
+  };
+  int get_plane_layouts(int stride, PlaneLayout planes[3]);
+  GLuint fill_pixel_buffer(const uint8_t* pixels, int stride);
+  void* map_pixel_buffer();
+  void upload_from_pixel_buffer(GLuint pbo);
+  void upload_from_client(const uint8_t* pixels, int stride);
+  // pbo ring, its fences and mapping need GLES3, GLES2 uploads from client memory
+  bool is_pbo_supported() { return render_ctrl_->get_gl_version() >= 3; }
+  void provide_mapped_buffer();
+  void release_mapped_buffer();
+  int upload_queued_frame();
   int setup_program();
   void reset_mvp_matrix();
+  int setup_convert_pass(int width, int height);
+  void release_convert_pass();
+  void drain_converted_frames();
+  void convert_frame();
 
   GLProgram *program_ = nullptr;
   int mvp_matrix_handle_ = -1;
@@ -72,26 +176,93 @@ protected:
   int tex_coord_handle_ = -1;
   int color_map_handle_ = -1;
   int uv_color_map_handle_ = -1;
+  int v_color_map_handle_ = -1;
+  int tex_width_handle_ = -1;
+  int color_matrix_handle_ = -1;
+  int color_offset_handle_ = -1;
 
   float mvp_matrix_[16];
   ScaleType tex_scale_type_ = SCALE_TYPE_SCALE_FIT;
   PixelFormat tex_format_ = PIXEL_FORMAT_YUYV;
+  float color_matrix_[9];
+  float color_offset_[3];
 
   Texture *input_texture_ = nullptr;
-  Texture *input_texture_uv_ = nullptr;
+  Texture *input_texture_uv_ = nullptr; // chroma of NV12/NV21, U plane of I420
+  Texture *input_texture_v_ = nullptr; // V plane of I420
   int tex_width_ = 0;
   int tex_height_ = 0;
+  // input textures are allocated for this size, frames no larger are drawn from a part of them
+  int storage_width_ = 0;
+  int storage_height_ = 0;
+  float tex_coords_[8];
 
-  GLuint pixel_buffer_object_ = 0;
+  static const int NUM_PIXEL_BUFFERS = 3;
+  // ring of pbos, a slot is written again only after the gpu signaled its fence
+  GLuint pixel_buffer_objects_[NUM_PIXEL_BUFFERS] = { 0 };
+  GLsync pixel_buffer_fences_[NUM_PIXEL_BUFFERS] = { 0 };
+  int pixel_buffer_index_ = 0;
+  std::vector<uint8_t> client_pixels_; // strided frames packed for GLES2 uploads
+  // slot of the ring mapped for capturer, guarded by pixel_mutex_
+  volatile bool is_buffer_provided_ = false;
+  unsigned char* mapped_buffer_ = nullptr;
+  int mapped_size_ = 0;
+  bool is_mapped_acquired_ = false;
+  bool is_mapped_committed_ = false;
+  // last slot handed back through commit_buffer, capturers pass it to upload_texture again
+  unsigned char* committed_buffer_ = nullptr;
   volatile bool need_reset_pbo_ = false;
   pthread_mutex_t pixel_mutex_;
   uint8_t* pixel_buffer_ = nullptr;
+  FrameQueue frame_queue_;
   volatile bool is_pixel_updated = false;
+  bool is_full_update_ = true;
+  std::vector<Rect> dirty_rects_;
+
+  struct DmabufTexture {
+    void* image_ = nullptr;
+    Texture* texture_ = nullptr;
+  };
+  // dmabufs are told apart by device and inode, fd numbers are reused once buffers are closed
+  typedef std::pair<dev_t, ino_t> DmabufId;
+  std::map<DmabufId, DmabufTexture> dmabuf_textures_;
+  DmabufTexture* dmabuf_texture_ = nullptr; // frame to be drawn, null when drawing uploaded pixels
+  int pending_dmabuf_fd_ = -1;
+  DmabufId pending_dmabuf_id_;
+  int dmabuf_stride_ = 0;
+  volatile bool is_dmabuf_failed_ = false;
+  volatile bool is_dmabuf_dropped_ = false;
 
   int output_width_ = 0;
   int output_height_ = 0;
   volatile bool is_force_refresh_ = false;
 
+  // settings of conversion for encoders, taken by render thread when changed, guarded by pixel_mutex_
+  volatile bool is_convert_changed_ = false;
+  ConvertedFrameCallback pending_convert_callback_;
+  PixelFormat pending_convert_format_ = PIXEL_FORMAT_NV12;
+  float pending_convert_matrix_[9];
+  float pending_convert_offset_[3];
+  // conversion pass, render thread only: one rgba target whose bytes are the planes of output
+  ConvertedFrameCallback convert_callback_;
+  PixelFormat convert_format_ = PIXEL_FORMAT_NV12;
+  float convert_matrix_[9];
+  float convert_offset_[3];
+  GLProgram* convert_program_ = nullptr;
+  int convert_vertices_handle_ = -1;
+  int convert_mvp_matrix_handle_ = -1;
+  int convert_color_map_handle_ = -1;
+  int convert_frame_size_handle_ = -1;
+  int convert_content_size_handle_ = -1;
+  int convert_storage_size_handle_ = -1;
+  int convert_color_matrix_handle_ = -1;
+  int convert_color_offset_handle_ = -1;
+  int convert_is_planar_handle_ = -1;
+  Texture* convert_texture_ = nullptr;
+  GLuint convert_frame_buffer_ = 0;
+  int convert_width_ = 0;
+  int convert_height_ = 0;
+
   RenderCtrl* render_ctrl_ = nullptr;
   EGLSurface cur_window_surface_ = 0;
   void* cur_window_ = nullptr;
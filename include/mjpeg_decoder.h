@@ -0,0 +1,97 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Andy Young
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef MJPEG_DECODER_H
+#define MJPEG_DECODER_H
+
+#include <pthread.h>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+struct DecodedFrame {
+  unsigned char* data_ = nullptr; // I420, planes packed without padding
+  int length_ = 0; // negative if decoding failed
+  int width_ = 0;
+  int height_ = 0;
+  int tag_ = -1; // passed through from submit
+};
+
+/**
+ * @brief MjpegDecoder, decodes MJPEG frames to I420 with libjpeg(-turbo) raw data output,
+ *        so no color conversion or chroma upsampling is done; output buffers come from a pool
+ *        and must be given back by recycle. Decoding can be done in caller's thread (decode)
+ *        or in a worker thread (submit/fetch), one of them should be used at a time
+ */
+class MjpegDecoder
+{
+public:
+  MjpegDecoder();
+  ~MjpegDecoder();
+
+  /**
+   * @brief decode, decode in caller's thread
+   * @return length of decoded frame, negative value if frame is corrupted or not 4:2:x sampled
+   */
+  int decode(const unsigned char* src, int length, DecodedFrame& frame);
+  void recycle(DecodedFrame& frame);
+
+  void start_worker();
+  void stop_worker();
+  /**
+   * @brief submit, hand a frame to worker, src must stay valid until it is fetched
+   * @return false if worker is busy with or holding a decoded frame not fetched yet
+   */
+  bool submit(const unsigned char* src, int length, int tag);
+  /**
+   * @brief fetch, get the frame decoded by worker, its tag tells which source is done
+   * @return false if nothing decoded since last fetch
+   */
+  bool fetch(DecodedFrame& frame);
+  bool is_busy();
+
+private:
+  int decode_internal(const unsigned char* src, int length, DecodedFrame& frame);
+  unsigned char* acquire_buffer(size_t size);
+  static void* work_loop(void* data);
+
+  std::mutex decode_mutex_;
+  std::vector<unsigned char> scratch_;
+
+  std::mutex pool_mutex_;
+  std::vector<unsigned char*> free_buffers_;
+  size_t buffer_size_ = 0;
+
+  pthread_t work_thread_;
+  volatile bool is_running_ = false;
+  std::mutex work_mutex_;
+  std::condition_variable cv_;
+  const unsigned char* pending_src_ = nullptr;
+  int pending_length_ = 0;
+  int pending_tag_ = -1;
+  bool has_pending_ = false;
+  bool has_result_ = false;
+  DecodedFrame result_;
+};
+
+#endif // MJPEG_DECODER_H
@@ -25,38 +25,47 @@
 #define OBJECT_CACHER_H
 
 #include "cacheable.h"
-#include <map>
+#include <unordered_map>
+#include <vector>
 #include <mutex>
 
+/**
+ * @brief ObjectCacher, free-list of objects per key, once warmed up neither
+ *        fetch_object nor return_object allocates (besides creating a new object on miss),
+ *        with a budget set the least recently returned objects are deleted to stay within it
+ */
 template <typename T = Cacheable, typename A = Cacheable::Attributes>
 class ObjectCacher {
 public:
-  ObjectCacher() : lock_(), cached_objects_(), type_counts_() {}
+  struct Stats {
+    unsigned long hits_ = 0;
+    unsigned long misses_ = 0;
+    unsigned long evictions_ = 0;
+    size_t cached_bytes_ = 0; // held by the cache, objects fetched out are not counted
+  };
+
+  ObjectCacher() : lock_(), cached_objects_() {}
 
   virtual ~ObjectCacher() {
     purge_cache();
   }
 
   inline T* fetch_object(int width, int height, A* attributes) {
-    T* object_from_cache = nullptr;
-    std::string lookup_hash = Cacheable::get_hash(width, height, attributes);
-    int number_of_matching_objects = 0;
+    Cacheable::Key key = Cacheable::get_key(width, height, attributes);
 
     {
       std::lock_guard<std::mutex> lck(lock_);
-      if (type_counts_.find(lookup_hash) != type_counts_.end()) {
-        number_of_matching_objects = type_counts_[lookup_hash];
-      }
-      if (number_of_matching_objects < 1) {
-        object_from_cache = T::create(width, height, attributes);
-      } else {
-        std::string object_hash = str_format("%s-%ld", lookup_hash.c_str(), --number_of_matching_objects);
-        object_from_cache = cached_objects_[object_hash];
-        cached_objects_.erase(object_hash);
-        type_counts_[lookup_hash] = number_of_matching_objects;
+      auto iter = cached_objects_.find(key);
+      if (iter != cached_objects_.end() && !iter->second.empty()) {
+        T* object_from_cache = iter->second.back().object_;
+        iter->second.pop_back(); // capacity is kept for the object to be returned
+        stats_.hits_++;
+        stats_.cached_bytes_ -= object_from_cache->get_byte_size();
+        return object_from_cache;
       }
+      stats_.misses_++;
     }
-    return object_from_cache;
+    return T::create(width, height, attributes);
   }
 
   inline bool return_object(T* object) {
@@ -65,37 +74,80 @@ public:
       delete object;
       return false;
     }
-    std::string lookup_hash = Cacheable::get_hash(object->get_width(), object->get_height(),
+    Cacheable::Key key = Cacheable::get_key(object->get_width(), object->get_height(),
         object->get_attributes());
-    int number_of_matching_objects = 0;
 
     {
       std::lock_guard<std::mutex> lck(lock_);
-      if (type_counts_.find(lookup_hash) != type_counts_.end()) {
-        number_of_matching_objects = type_counts_[lookup_hash];
-      }
-      std::string object_hash = str_format("%s-%ld", lookup_hash.c_str(), number_of_matching_objects++);
-      cached_objects_[object_hash] = object;
-      type_counts_[lookup_hash] = number_of_matching_objects;
+      cached_objects_[key].push_back(CachedObject{object, ++return_stamp_});
+      stats_.cached_bytes_ += object->get_byte_size();
+      if (is_evict_on_return_) evict_objects();
     }
     return true;
   }
 
+  /**
+   * @brief set_budget, bytes the cache may hold, 0 for unlimited
+   * @param is_evict_on_return, evict in return_object (in the thread returning objects),
+   *        false if objects must be deleted in a certain thread, which calls trim_to_budget then
+   */
+  inline void set_budget(size_t bytes, bool is_evict_on_return = true) {
+    std::lock_guard<std::mutex> lck(lock_);
+    budget_bytes_ = bytes;
+    is_evict_on_return_ = is_evict_on_return;
+  }
+
+  inline void trim_to_budget() {
+    std::lock_guard<std::mutex> lck(lock_);
+    evict_objects();
+  }
+
+  inline Stats get_stats() const {
+    std::lock_guard<std::mutex> lck(lock_);
+    return stats_;
+  }
+
   inline bool purge_cache() {
     std::lock_guard<std::mutex> lck(lock_);
-    for (const auto kvp : cached_objects_) {
-      delete kvp.second;
+    for (const auto& kvp : cached_objects_) {
+      for (const CachedObject& cached : kvp.second) delete cached.object_;
     }
     cached_objects_.clear();
-    type_counts_.clear();
+    stats_.cached_bytes_ = 0;
     return true;
   }
 
 protected:
+  struct CachedObject {
+    T* object_;
+    unsigned long stamp_; // order of returning, oldest of a free-list is at its front
+  };
+
+  inline void evict_objects() {
+    while (budget_bytes_ > 0 && stats_.cached_bytes_ > budget_bytes_) {
+      // keys are few, finding the oldest front beats keeping a list which allocates per object
+      std::vector<CachedObject>* oldest = nullptr;
+      for (auto& kvp : cached_objects_) {
+        if (!kvp.second.empty()
+         && (!oldest || kvp.second.front().stamp_ < oldest->front().stamp_)) {
+          oldest = &kvp.second;
+        }
+      }
+      if (!oldest) break;
+      T* object = oldest->front().object_;
+      oldest->erase(oldest->begin());
+      stats_.cached_bytes_ -= object->get_byte_size();
+      stats_.evictions_++;
+      delete object;
+    }
+  }
 
   mutable std::mutex lock_;
-  std::map<std::string, T*> cached_objects_;
-  std::map<std::string, int> type_counts_;
+  std::unordered_map<Cacheable::Key, std::vector<CachedObject>, Cacheable::KeyHash> cached_objects_;
+  unsigned long return_stamp_ = 0;
+  size_t budget_bytes_ = 0;
+  bool is_evict_on_return_ = true;
+  Stats stats_;
 };
 
 #endif // OBJECT_CACHER_H
@@ -24,9 +24,13 @@
 #ifndef RENDER_CTRL_H
 #define RENDER_CTRL_H
 
+#include <atomic>
+#include <chrono>
 #include <mutex>
 #include <condition_variable>
 #include <map>
+#include <queue>
+#include <vector>
 #include "egl_core.h"
 #include "texture.h"
 #include "object_cacher.h"
@@ -36,13 +40,33 @@ class GLRenderer;
 class RenderCtrl
 {
 public:
+  enum RenderMode
+  {
+    RENDER_MODE_TIMER = 0, // visit renderers every frame interval
+    RENDER_MODE_ON_FRAME, // sleep until a renderer has something new, at most fps times a second
+  };
+
   RenderCtrl();
   virtual ~RenderCtrl();
 
   void start();
   void stop();
 
+  /**
+   * @brief set_fps, rendering rate in timer mode, upper limit of it in on-frame mode
+   */
   void set_fps(float fps);
+  /**
+   * @brief set_fps, rate of one renderer, it is drawn only when due,
+   *        renderer with fps not above 0 follows the rate of controller
+   */
+  void set_fps(GLRenderer* renderer, float fps);
+  void set_render_mode(RenderMode mode);
+  /**
+   * @brief request_render, wake the render thread up in on-frame mode,
+   *        cheap enough to be called for each frame from any thread
+   */
+  void request_render();
 
   void add_renderer(GLRenderer* renderer);
   void remove_renderer(GLRenderer* renderer);
@@ -52,23 +76,47 @@ public:
   void release_surface(EGLSurface& surface);
   void swap_buffer(EGLSurface& surface);
   void make_current(EGLSurface& surface);
+  int get_gl_version();
+  bool is_dmabuf_supported() { return is_dmabuf_supported_; }
+  void* create_dmabuf_image(int fd, int width, int height, int fourcc, int pitch);
+  void release_image(void* image);
 
   Texture* fetch_texture(int width, int height,
                          Cacheable::Attributes* attribute = Texture::s_default_texture_attributes_);
   void return_texture(Texture* texture);
+  /**
+   * @brief set_texture_budget, bytes of idle textures kept for reuse,
+   *        least recently returned ones are deleted beyond it in render thread, 0 for unlimited
+   */
+  void set_texture_budget(size_t bytes);
+  ObjectCacher<Texture, Texture::Attributes>::Stats get_texture_stats();
 
 private:
   void setup_egl();
   void release_egl();
+  typedef std::chrono::steady_clock::time_point TimePoint;
+  typedef std::pair<TimePoint, GLRenderer*> DueEntry;
+
+  struct Schedule
+  {
+    int interval_us_ = 0; // 0 to follow interval_us_ of controller
+    TimePoint due_time_;
+  };
+
   void setup_renderers();
-  void do_rendering();
+  TimePoint do_rendering();
   void release_renderers();
+  void schedule_renderer(GLRenderer* renderer, const TimePoint& due_time);
+  TimePoint get_last_due_time();
+  bool wait_for_render(const TimePoint& next_time, const TimePoint& serve_until);
   static void* render_loop(void* data);
 
   pthread_t  render_thread_;
   volatile bool is_running_ = false;
   volatile int interval_us_ = 1000000 / 30;
   volatile bool is_done_release_ = true;
+  volatile bool is_dmabuf_supported_ = false;
+  volatile RenderMode render_mode_ = RENDER_MODE_TIMER;
 
   EglCore   *egl_core_ = nullptr;
   EGLSurface cur_background_surface_ = 0;
@@ -77,6 +125,13 @@ private:
   std::mutex render_mutex_;
   std::condition_variable cv_;
   std::map<GLRenderer*, int> renderer_list_;
+  std::map<GLRenderer*, Schedule> renderer_schedules_;
+  // min-heap of next due times, entries out of date with renderer_schedules_ are skipped
+  std::priority_queue<DueEntry, std::vector<DueEntry>, std::greater<DueEntry>> due_queue_;
+
+  std::mutex wake_mutex_;
+  std::condition_variable wake_cv_;
+  std::atomic<bool> is_render_requested_;
 };
 
 #endif // RENDER_CTRL_H
@@ -41,10 +41,12 @@ public:
     GLenum type_ = GL_UNSIGNED_BYTE;
     GLenum target_ = GL_TEXTURE_2D;
 
-    inline std::string get_hash() const override {
-      return str_format("%d:%d:%d:%d:%d:%d:%d:%d",
-                        min_filter_, mag_filter_, wrap_s_, wrap_t_,
-                        internal_format_, format_, type_, target_);
+    inline void fill_key(Key& key) const override {
+      // enums used for textures all fit in 16 bits
+      key.attributes_[0] = (uint64_t) (min_filter_ & 0xffff) << 48 | (uint64_t) (mag_filter_ & 0xffff) << 32
+                         | (uint64_t) (wrap_s_ & 0xffff) << 16 | (wrap_t_ & 0xffff);
+      key.attributes_[1] = (uint64_t) (internal_format_ & 0xffff) << 48 | (uint64_t) (format_ & 0xffff) << 32
+                         | (uint64_t) (type_ & 0xffff) << 16 | (target_ & 0xffff);
     }
   };
 
@@ -56,12 +58,64 @@ public:
 
   GLuint get_texture();
 
-  bool need_be_cached() override { return has_gen_tex_; }
+  bool need_be_cached() override { return has_gen_tex_ && !is_image_attached_; }
+  /**
+   * @brief get_byte_size, estimated from internal format, drivers may pad more
+   */
+  size_t get_byte_size() const override;
 
-  void upload_pixel_from_pbo(int pbo);
+  /**
+   * @brief set_content_size, part of the texture holding pixels, starting at (0, 0),
+   *        uploads cover it instead of the whole storage
+   */
+  void set_content_size(int width, int height) { content_width_ = width; content_height_ = height; }
+  int get_content_width() const { return content_width_; }
+  int get_content_height() const { return content_height_; }
+  /**
+   * @brief get_storage_width, width allocated in gl, rounded up from width
+   */
+  int get_storage_width() const;
+
+  /**
+   * @brief upload_pixel_from_pbo, rows are taken tightly packed
+   * @param offset, bytes from the start of pbo, for planes of a multi-plane frame
+   */
+  void upload_pixel_from_pbo(int pbo, size_t offset = 0);
+  /**
+   * @brief upload_pixels, upload a tightly packed frame from client memory immediately,
+   *        must be called in gl thread, works without pbo (GLES2)
+   */
+  void upload_pixels(const unsigned char* pixels);
   void upload_pixel_from_buffer(unsigned char* pixel_buffer);
+  /**
+   * @brief upload_sub_pixels, upload a rectangle of a client side frame immediately,
+   *        must be called in gl thread (GLES3 only)
+   * @param pixels, start of the whole frame
+   * @param row_length, pixels per row of the whole frame
+   */
+  void upload_sub_pixels(const unsigned char* pixels, int x, int y, int width, int height, int row_length);
+  /**
+   * @brief attach_egl_image, sample from an EGLImage instead of own storage,
+   *        such texture is never cached, must be called in gl thread
+   * @param egl_image, EGLImageKHR
+   * @return false if GL_OES_EGL_image is not available
+   */
+  bool attach_egl_image(void* egl_image);
 
-  void download_pixels(unsigned char* &pixel_buffer) { /* TODO:: using pbo */ }
+  /**
+   * @brief download_pixels, asynchronous readback through a ring of pack pbos, must be called in gl thread,
+   *        each call queues a read of the content and hands out the oldest read the gpu has finished,
+   *        so pixels of a call come one or two calls later, it waits only when all pbos are in flight
+   * @param pixel_buffer, set to rgba rows of content width * 4 bytes (luminance comes back in red),
+   *        mapped until the next call or finish_download, nullptr if no read has finished yet
+   * @param is_flush, queue nothing and wait for the oldest read, to drain reads at the end
+   * @return bytes of pixel_buffer, negative value if texture can not be read (not color-renderable)
+   */
+  int download_pixels(unsigned char* &pixel_buffer, bool is_flush = false);
+  /**
+   * @brief finish_download, drop reads in flight and release pbos, must be called in gl thread
+   */
+  void finish_download();
 
   inline Cacheable::Attributes* get_attributes() const override { return (Cacheable::Attributes*) &attributes_; };
   inline const Attributes& get_texture_attributes() const { return attributes_; };
@@ -71,14 +125,31 @@ public:
 private:
   bool has_gen_tex_ = false;
   Attributes attributes_;
+  GLenum upload_format_ = 0; // differs from attributes_.format_ with immutable storage of luminance
+  int content_width_ = 0;
+  int content_height_ = 0;
   GLuint texture_ = 0;
   unsigned char* pixel_buffer_ = nullptr;
   std::mutex pixel_lock_;
   bool need_reset_texture_ = false;
+  bool is_image_attached_ = false;
+
+  static const int NUM_PACK_BUFFERS = 3;
+  GLuint frame_buffer_ = 0;
+  GLuint pack_buffers_[NUM_PACK_BUFFERS] = { 0 };
+  GLsync pack_fences_[NUM_PACK_BUFFERS] = { 0 };
+  int pack_capacities_[NUM_PACK_BUFFERS] = { 0 };
+  int pack_lengths_[NUM_PACK_BUFFERS] = { 0 }; // bytes of the read queued in slot
+  int pack_index_ = 0; // slot for next read, oldest in flight is pack_count_ slots before
+  int pack_count_ = 0;
+  int mapped_pack_ = -1; // slot handed out by download_pixels
 
 private:
 
-  void generate_texture();
+  void generate_texture(bool is_allocate = true);
+  bool allocate_storage();
+  int read_into_pack_buffer();
+  int map_oldest_pack_buffer(unsigned char* &pixel_buffer, bool is_wait);
   void destroy_texture();
 };
 
@@ -32,44 +32,91 @@ extern "C"{
 #endif
 
 #define V4L2_STATUS_OK 1
+#define V4L2_STATUS_TIMEOUT 0
+#define V4L2_STATUS_AGAIN 0 // no frame available yet
 #define V4L2_STATUS_ERROR -1
 
+#define V4L2_DEFAULT_BUFFERS 4
+
 typedef struct v4l2_buffer_s {
   void *start_;
   size_t length_;
+  int dmabuf_fd_; // -1 if not exported
 } v4l2_buffer_t;
 
 typedef struct v4l2_format_s {
   unsigned int width_;
   unsigned int height_;
-  unsigned int pixel_format_;
+  unsigned int pixel_format_; // fourcc, 0 keeps the one currently set on the driver
+  unsigned int bytes_per_line_;
+  unsigned int fps_; // 0 keeps the frame rate currently set on the driver
+  unsigned int colorspace_; // enum v4l2_colorspace, reported by driver only
+  unsigned int ycbcr_enc_; // enum v4l2_ycbcr_encoding
+  unsigned int quantization_; // enum v4l2_quantization
 } v4l2_format_t;
 
+/* one format/size/frame rate combination supported by a device */
+typedef struct v4l2_mode_s {
+  unsigned int pixel_format_;
+  unsigned int width_;
+  unsigned int height_;
+  unsigned int fps_; // highest frame rate, rounded down
+} v4l2_mode_t;
+
+typedef struct v4l2_frame_s {
+  int index_;
+  unsigned char* data_;
+  size_t length_;
+  int dmabuf_fd_;
+  long long timestamp_us_; // when driver captured it, CLOCK_MONOTONIC for most drivers
+} v4l2_frame_t;
+
 typedef struct v4l2_device_s {
   char name_[32];
   char description_[32];
   int fd_;
   unsigned int num_buffers_;
+  unsigned int req_buffers_; // buffers to request on open, driver may adjust it
   v4l2_buffer_t* buffers_;
   v4l2_format_t format_;
   unsigned char* data_;
+  unsigned int max_borrowed_; // buffers allowed to be held by consumers at the same time
+  unsigned int num_borrowed_;
 } v4l2_device_t;
 
 v4l2_device_t* v4l2_create_device(const char* device_name);
 void v4l2_destroy_device(v4l2_device_t *device);
 
+/* query capabilities and current format only, no buffer is requested */
+int v4l2_probe_device(v4l2_device_t *device);
 int v4l2_open_device(v4l2_device_t *device);
 int v4l2_close_device(v4l2_device_t *device);
 
 int v4l2_set_format(v4l2_device_t* device, v4l2_format_t* format);
 int v4l2_get_format(v4l2_device_t* device, v4l2_format_t* format);
 
+/* enumerate formats/sizes/frame rates (ENUM_FMT/ENUM_FRAMESIZES/ENUM_FRAMEINTERVALS),
+ * the device is opened temporarily if not opened yet,
+ * returns number of modes found (may exceed max_modes), or V4L2_STATUS_ERROR */
+int v4l2_enum_modes(v4l2_device_t* device, v4l2_mode_t* modes, int max_modes);
+
 int v4l2_start_capture(v4l2_device_t *device);
 int v4l2_stop_capture(v4l2_device_t *device);
 
+/* block until a buffer is filled by driver, timeout in ms (negative for infinite) */
+int v4l2_wait_frame(v4l2_device_t *device, int timeout_ms);
 int v4l2_grab_frame(v4l2_device_t *device);
 void v4l2_copy_frame(v4l2_device_t *device, unsigned char* dest);
 
+/* zero-copy access, the mmapped buffer is requeued only when it is released */
+int v4l2_borrow_frame(v4l2_device_t *device, v4l2_frame_t* frame);
+int v4l2_release_frame(v4l2_device_t *device, v4l2_frame_t* frame);
+/* dequeue a completed buffer and requeue it at once, regardless of frames borrowed */
+int v4l2_drop_frame(v4l2_device_t *device);
+
+/* export mmapped buffers as dmabuf fds (VIDIOC_EXPBUF), must be called after open */
+int v4l2_export_buffers(v4l2_device_t *device);
+
 #ifdef __cplusplus
 }
 #endif
@@ -38,22 +38,45 @@ public:
   const std::vector<DeviceInfo> enum_devices() override;
   int bind_device(DeviceInfo dev) override;
   int unbind_device() override;
+  using ICaptureDevice::grab_frame;
   int grab_frame(unsigned char* &buffer) override;
+  int grab_frame(unsigned char* &buffer, std::vector<Rect>& dirty) override;
+  /**
+   * @brief set_damage_gated, consult the damage queue before touching the window,
+   *        geometry queries and XShmGetImage are skipped while the window is clean
+   * @param is_gated
+   */
+  void set_damage_gated(bool is_gated) { is_damage_gated_ = is_gated; }
+  unsigned long get_grabbed_frames() const { return grabbed_frames_; }
+  unsigned long get_skipped_frames() const { return skipped_frames_; }
 
 protected:
   bool is_window_fixed = false;
 
 private:
+  void process_pending_events();
   bool is_window_redrawed();
   int resize_window_internal(int x, int y, int width, int height);
+  int update_geometry();
+  int fetch_image();
+  int fetch_image(const Rect& rect);
   Display* cur_display_ = nullptr;
   XImage* cur_image_ = nullptr;
   XShmSegmentInfo* shm_info_ = nullptr;
+  // staging image for partial fetching, allocated on first use
+  XImage* patch_image_ = nullptr;
+  XShmSegmentInfo* patch_shm_info_ = nullptr;
 
   // adaptive fps related
   Damage damage_handle_ = 0;
   int damage_event_base_ = 0;
   int damage_error_base_ = 0;
+  std::vector<Rect> damage_rects_;
+  bool is_damage_gated_ = false;
+  bool is_content_dirty_ = true;
+  bool is_geometry_dirty_ = true;
+  unsigned long grabbed_frames_ = 0;
+  unsigned long skipped_frames_ = 0;
 };
 
 #endif // WINDOW_CAPTURER_H
@@ -23,9 +23,43 @@
  */
 #include "camera_device.h"
 #include <algorithm>
+#include <cstdio>
 #include <cstring>
+#include <cstdlib>
+#include <dirent.h>
 
-const std::string DEVICE_PREFIX = "/dev/video";
+const std::string DEVICE_DIR = "/dev/";
+const std::string SYSFS_DEVICE_DIR = "/sys/class/video4linux";
+const std::string DEVICE_NODE_PREFIX = "video";
+
+std::mutex CameraDevice::s_device_mutex_;
+std::vector<DeviceInfo> CameraDevice::s_devices_;
+bool CameraDevice::s_is_devices_valid_ = false;
+
+/**
+ * @brief list_video_nodes, numbers of videoN nodes in ascending order,
+ *        sysfs is preferred, /dev is scanned when sysfs is not mounted
+ */
+static std::vector<int> list_video_nodes()
+{
+  std::vector<int> nodes;
+  DIR* dir = opendir(SYSFS_DEVICE_DIR.c_str());
+  if (!dir) dir = opendir(DEVICE_DIR.c_str());
+  if (!dir) return nodes;
+
+  dirent* entry = nullptr;
+  while ((entry = readdir(dir)) != nullptr) {
+    if (strncmp(entry->d_name, DEVICE_NODE_PREFIX.c_str(), DEVICE_NODE_PREFIX.size())) continue;
+    const char* num = entry->d_name + DEVICE_NODE_PREFIX.size();
+    char* end = nullptr;
+    long id = strtol(num, &end, 10);
+    if (end == num || *end != '\0') continue;
+    nodes.push_back((int) id);
+  }
+  closedir(dir);
+  std::sort(nodes.begin(), nodes.end());
+  return nodes;
+}
 
 CameraDevice::CameraDevice()
 {
@@ -39,33 +73,81 @@ CameraDevice::~CameraDevice()
 
 const std::vector<DeviceInfo> CameraDevice::enum_devices()
 {
-  std::vector<DeviceInfo> dev_list;
-  v4l2_device_t* tmp_cam = nullptr;
-  for (int i = 0; i < 8; i++) {
-    std::string tmp_name = DEVICE_PREFIX + std::to_string(i);
-    tmp_cam = v4l2_create_device(tmp_name.c_str());
-    if (!tmp_cam) continue;
-    if (v4l2_open_device(tmp_cam) != V4L2_STATUS_OK) {
-      v4l2_destroy_device(tmp_cam);
-      continue;
-    }
-    v4l2_get_format(tmp_cam, &tmp_cam->format_);
-    // v4l2_enum_format(tmp_cam, &tmp_cam->format_);
+  std::unique_lock<std::mutex> lock(s_device_mutex_);
+  load_devices();
+  return s_devices_;
+}
+
+void CameraDevice::load_devices()
+{
+  if (s_is_devices_valid_) return;
 
+  s_devices_.clear();
+  for (int id : list_video_nodes()) {
     DeviceInfo dev;
-    dev.format_ = get_pixel_format(tmp_cam->format_);
+    dev.dev_id_ = id;
+    if (probe_device(DEVICE_DIR + DEVICE_NODE_PREFIX + std::to_string(id), dev)) {
+      s_devices_.push_back(dev);
+    }
+  }
+  s_is_devices_valid_ = true;
+}
+
+bool CameraDevice::add_cached_device(const std::string& node, DeviceInfo& dev)
+{
+  std::unique_lock<std::mutex> lock(s_device_mutex_);
+  load_devices();
+  std::string path = DEVICE_DIR + node;
+  for (const DeviceInfo& item : s_devices_) {
+    if (item.name_ == path) return false; // known already
+  }
+  dev.dev_id_ = strtol(node.c_str() + DEVICE_NODE_PREFIX.size(), nullptr, 10);
+  if (!probe_device(path, dev)) return false;
+  auto pos = std::find_if(s_devices_.begin(), s_devices_.end(),
+                          [&](const DeviceInfo& item) { return item.dev_id_ > dev.dev_id_; });
+  s_devices_.insert(pos, dev);
+  return true;
+}
+
+bool CameraDevice::remove_cached_device(const std::string& node, DeviceInfo& dev)
+{
+  std::unique_lock<std::mutex> lock(s_device_mutex_);
+  std::string path = DEVICE_DIR + node;
+  for (auto iter = s_devices_.begin(); iter != s_devices_.end(); iter++) {
+    if (iter->name_ == path) {
+      dev = *iter;
+      s_devices_.erase(iter);
+      return true;
+    }
+  }
+  return false;
+}
+
+void CameraDevice::invalidate_devices()
+{
+  std::unique_lock<std::mutex> lock(s_device_mutex_);
+  s_is_devices_valid_ = false;
+}
+
+bool CameraDevice::probe_device(const std::string& node, DeviceInfo& dev)
+{
+  v4l2_device_t* tmp_cam = v4l2_create_device(node.c_str());
+  if (!tmp_cam) return false;
+  bool is_capturable = v4l2_probe_device(tmp_cam) == V4L2_STATUS_OK;
+  if (is_capturable) {
+    if (!get_pixel_format(tmp_cam->format_.pixel_format_, dev.format_)) {
+      dev.format_ = PIXEL_FORMAT_YUYV; // negotiated again on start_device
+    }
+    get_color_space(tmp_cam->format_, dev);
     dev.pos_x_ = 0;
     dev.pos_y_ = 0;
     dev.width_ = (int) tmp_cam->format_.width_;
     dev.height_ = (int) tmp_cam->format_.height_;
-    dev.name_ = tmp_name;
-    dev.dev_id_ = i;
-    dev.ext_data_ = (unsigned char *)tmp_cam;
-    dev_list.push_back(dev);
-    v4l2_close_device(tmp_cam);
-    v4l2_destroy_device(tmp_cam);
+    dev.name_ = node;
+    dev.ext_data_ = nullptr;
   }
-  return dev_list;
+  v4l2_destroy_device(tmp_cam);
+  return is_capturable;
 }
 
 int CameraDevice::bind_device(DeviceInfo dev)
@@ -73,6 +155,8 @@ int CameraDevice::bind_device(DeviceInfo dev)
   unbind_device();
 
   v4l2_cam_ = v4l2_create_device(dev.name_.c_str());
+  v4l2_cam_->max_borrowed_ = max_borrowed_frames_;
+  v4l2_cam_->req_buffers_ = buffer_count_;
   cur_dev_ = dev;
   return 0;
 }
@@ -83,9 +167,60 @@ void CameraDevice::set_preview_size(int width, int height)
   cur_dev_.height_ = height;
 }
 
+std::vector<CameraMode> CameraDevice::enum_modes()
+{
+  std::vector<CameraMode> modes;
+  if (!v4l2_cam_) return modes;
+
+  std::vector<v4l2_mode_t> items(64);
+  int count = v4l2_enum_modes(v4l2_cam_, items.data(), (int) items.size());
+  if (count > (int) items.size()) {
+    items.resize(count);
+    count = v4l2_enum_modes(v4l2_cam_, items.data(), (int) items.size());
+  }
+  for (int i = 0; i < std::min(count, (int) items.size()); i++) {
+    CameraMode mode;
+    if (!get_pixel_format(items[i].pixel_format_, mode.format_)) continue;
+    mode.width_ = (int) items[i].width_;
+    mode.height_ = (int) items[i].height_;
+    mode.fps_ = (int) items[i].fps_;
+    modes.push_back(mode);
+  }
+  return modes;
+}
+
+void CameraDevice::set_capture_mode(const CameraMode& mode)
+{
+  set_preview_size(mode.width_, mode.height_);
+  unsigned int fourcc = get_fourcc(mode.format_);
+  req_fourcc_ = fourcc ? fourcc : V4L2_PIX_FMT_YUYV;
+  req_fps_ = std::max(mode.fps_, 0);
+}
+
+int CameraDevice::get_frame_rate()
+{
+  if (!v4l2_cam_) return 0;
+  return (int) v4l2_cam_->format_.fps_;
+}
+
+void CameraDevice::set_buffer_count(int count)
+{
+  buffer_count_ = std::max(count, 2);
+  if (v4l2_cam_) v4l2_cam_->req_buffers_ = buffer_count_;
+}
+
+int CameraDevice::wait_frame(int timeout_ms)
+{
+  if (!v4l2_cam_) return -1;
+  int res = v4l2_wait_frame(v4l2_cam_, timeout_ms);
+  if (res == V4L2_STATUS_TIMEOUT) return 0;
+  return res == V4L2_STATUS_OK ? 1 : -1;
+}
+
 int CameraDevice::unbind_device()
 {
   if (!v4l2_cam_) return 0;
+  release_decoder();
   v4l2_destroy_device(v4l2_cam_);
   v4l2_cam_ = nullptr;
   cur_dev_.name_ = "";
@@ -97,12 +232,32 @@ int CameraDevice::start_device()
   if (!v4l2_cam_) return -1;
   v4l2_cam_->format_.width_ = cur_dev_.width_;
   v4l2_cam_->format_.height_ = cur_dev_.height_;
+  v4l2_cam_->format_.pixel_format_ = req_fourcc_;
+  v4l2_cam_->format_.fps_ = req_fps_;
   if (v4l2_open_device(v4l2_cam_) != V4L2_STATUS_OK) {
     return -1;
   }
+  if (!get_pixel_format(v4l2_cam_->format_.pixel_format_, cur_dev_.format_)) {
+    fprintf(stderr, "Unsupported pixel format on device: %s\n", cur_dev_.name_.c_str());
+    v4l2_close_device(v4l2_cam_);
+    return -1;
+  }
   cur_dev_.width_ = v4l2_cam_->format_.width_;
   cur_dev_.height_ = v4l2_cam_->format_.height_;
+  get_color_space(v4l2_cam_->format_, cur_dev_);
+  if (cur_dev_.format_ == PIXEL_FORMAT_MJPEG && is_mjpeg_decode_) {
+    mjpeg_decoder_ = new MjpegDecoder();
+    if (is_mjpeg_threaded_) mjpeg_decoder_->start_worker();
+    cur_dev_.format_ = PIXEL_FORMAT_I420;
+    // JFIF, whatever the driver reports
+    cur_dev_.color_space_ = COLOR_SPACE_BT601;
+    cur_dev_.color_range_ = COLOR_RANGE_FULL;
+  }
+  if (is_dmabuf_export_) {
+    v4l2_export_buffers(v4l2_cam_); // not fatal, consumers fall back to mmapped pointers
+  }
   if (v4l2_start_capture(v4l2_cam_) != V4L2_STATUS_OK) {
+    release_decoder();
     v4l2_close_device(v4l2_cam_);
     return -1;
   }
@@ -112,6 +267,14 @@ int CameraDevice::start_device()
 int CameraDevice::stop_device()
 {
   if (!v4l2_cam_) return -1;
+  grabbed_index_ = -1;
+  release_decoder(); // worker may still read a mmapped buffer
+  {
+    // streamoff takes every buffer back, frames still lent out just become stale
+    std::unique_lock<std::mutex> lock(lent_frames_->mutex_);
+    lent_frames_->released_.clear();
+    lent_frames_->generation_++;
+  }
   if (v4l2_stop_capture(v4l2_cam_) != V4L2_STATUS_OK) {
     return -1;
   }
@@ -122,7 +285,8 @@ int CameraDevice::stop_device()
 }
 
 /**
- * @brief CameraDevice::grab_frame
+ * @brief CameraDevice::grab_frame, the mmapped buffer is handed out directly and
+ *        kept dequeued until the next successful grab_frame
  * @param buffer
  * @return the length of captured data
  */
@@ -131,25 +295,242 @@ int CameraDevice::grab_frame(unsigned char *&buffer)
   if (!v4l2_cam_) {
     return 0;
   }
-  if (v4l2_grab_frame(v4l2_cam_) != V4L2_STATUS_OK) {
+  if (mjpeg_decoder_) {
+    return grab_decoded_frame(buffer);
+  }
+  v4l2_frame_t frame;
+  int res = v4l2_borrow_frame(v4l2_cam_, &frame);
+  if (res == V4L2_STATUS_AGAIN) {
+    return 0; // no new frame yet
+  } else if (res != V4L2_STATUS_OK) {
     return -1;
   }
-  buffer = v4l2_cam_->data_;
-  return cur_dev_.width_ * cur_dev_.height_ * 2;
+  if (grabbed_index_ >= 0) release_frame(grabbed_index_);
+  grabbed_index_ = frame.index_;
+  buffer = frame.data_;
+  return (int) frame.length_;
+}
+
+int CameraDevice::grab_frame(Frame* &frame)
+{
+  frame = nullptr;
+  if (!v4l2_cam_) return 0;
+  if (mjpeg_decoder_) return ICaptureDevice::grab_frame(frame);
+
+  requeue_lent_frames();
+  v4l2_frame_t buffer;
+  int res = v4l2_borrow_frame(v4l2_cam_, &buffer);
+  if (res == V4L2_STATUS_AGAIN) {
+    return 0; // no new frame yet, or too many frames lent out
+  } else if (res != V4L2_STATUS_OK) {
+    return -1;
+  }
+
+  Frame::Attributes attr;
+  attr.format_ = cur_dev_.format_;
+  attr.stride_ = (int) v4l2_cam_->format_.bytes_per_line_;
+  std::shared_ptr<LentFrames> lent = lent_frames_;
+  int generation = lent->generation_;
+  int index = buffer.index_;
+  frame = Frame::wrap(buffer.data_, (int) buffer.length_, cur_dev_.width_, cur_dev_.height_, &attr,
+                      [lent, generation, index]() {
+    std::unique_lock<std::mutex> lock(lent->mutex_);
+    if (lent->generation_ == generation) lent->released_.push_back(index);
+  });
+  frame->set_timestamp(buffer.timestamp_us_);
+  return (int) buffer.length_;
 }
 
-PixelFormat CameraDevice::get_pixel_format(v4l2_format_t& format)
+void CameraDevice::requeue_lent_frames()
 {
-  switch(format.pixel_format_) {
+  std::vector<int> released;
+  {
+    std::unique_lock<std::mutex> lock(lent_frames_->mutex_);
+    released.swap(lent_frames_->released_);
+  }
+  for (int index : released) release_frame(index);
+}
+
+int CameraDevice::grab_decoded_frame(unsigned char *&buffer)
+{
+  DecodedFrame decoded;
+  v4l2_frame_t frame;
+  if (is_mjpeg_threaded_) {
+    if (mjpeg_decoder_->fetch(decoded)) {
+      release_frame(decoded.tag_);
+    }
+    if (!mjpeg_decoder_->is_busy()) {
+      int res = v4l2_borrow_frame(v4l2_cam_, &frame);
+      if (res == V4L2_STATUS_OK) {
+        mjpeg_decoder_->submit(frame.data_, (int) frame.length_, frame.index_);
+      } else if (res != V4L2_STATUS_AGAIN) {
+        return -1;
+      }
+    }
+  } else {
+    int res = v4l2_borrow_frame(v4l2_cam_, &frame);
+    if (res == V4L2_STATUS_AGAIN) {
+      return 0;
+    } else if (res != V4L2_STATUS_OK) {
+      return -1;
+    }
+    mjpeg_decoder_->decode(frame.data_, (int) frame.length_, decoded);
+    v4l2_release_frame(v4l2_cam_, &frame);
+  }
+
+  if (decoded.length_ <= 0) {
+    return 0; // nothing decoded or corrupted frame dropped
+  }
+  mjpeg_decoder_->recycle(decoded_frame_);
+  decoded_frame_ = decoded;
+  cur_dev_.width_ = decoded.width_;
+  cur_dev_.height_ = decoded.height_;
+  buffer = decoded.data_;
+  return decoded.length_;
+}
+
+void CameraDevice::release_decoder()
+{
+  if (!mjpeg_decoder_) return;
+  mjpeg_decoder_->stop_worker();
+  mjpeg_decoder_->recycle(decoded_frame_);
+  delete mjpeg_decoder_;
+  mjpeg_decoder_ = nullptr;
+  cur_dev_.format_ = PIXEL_FORMAT_MJPEG;
+}
+
+void CameraDevice::set_mjpeg_decode(bool is_enable, bool is_threaded)
+{
+  is_mjpeg_decode_ = is_enable;
+  is_mjpeg_threaded_ = is_threaded;
+}
+
+int CameraDevice::borrow_frame(unsigned char *&buffer, int &length)
+{
+  if (!v4l2_cam_) return -1;
+  v4l2_frame_t frame;
+  if (v4l2_borrow_frame(v4l2_cam_, &frame) != V4L2_STATUS_OK) {
+    return -1;
+  }
+  buffer = frame.data_;
+  length = (int) frame.length_;
+  return frame.index_;
+}
+
+int CameraDevice::release_frame(int index)
+{
+  if (!v4l2_cam_) return -1;
+  v4l2_frame_t frame;
+  frame.index_ = index;
+  if (v4l2_release_frame(v4l2_cam_, &frame) != V4L2_STATUS_OK) {
+    return -1;
+  }
+  return 0;
+}
+
+int CameraDevice::drop_frame()
+{
+  if (!v4l2_cam_) return -1;
+  int res = v4l2_drop_frame(v4l2_cam_);
+  if (res == V4L2_STATUS_AGAIN) {
+    return 0;
+  }
+  return res == V4L2_STATUS_OK ? 1 : -1;
+}
+
+void CameraDevice::set_max_borrowed_frames(int count)
+{
+  // grab_frame holds one frame while borrowing the next
+  max_borrowed_frames_ = std::max(count, 2);
+  if (v4l2_cam_) v4l2_cam_->max_borrowed_ = max_borrowed_frames_;
+}
+
+int CameraDevice::get_dmabuf_fd(int index)
+{
+  if (!v4l2_cam_) return -1;
+  if (index < 0) index = grabbed_index_;
+  if (index < 0 || index >= (int) v4l2_cam_->num_buffers_) return -1;
+  return v4l2_cam_->buffers_[index].dmabuf_fd_;
+}
+
+int CameraDevice::get_fd()
+{
+  if (!v4l2_cam_ || !v4l2_cam_->num_buffers_) return -1;
+  return v4l2_cam_->fd_;
+}
+
+int CameraDevice::get_bytes_per_line()
+{
+  if (!v4l2_cam_) return 0;
+  return (int) v4l2_cam_->format_.bytes_per_line_;
+}
+
+bool CameraDevice::get_pixel_format(unsigned int fourcc, PixelFormat& format)
+{
+  switch(fourcc) {
   case V4L2_PIX_FMT_ARGB32:
   case V4L2_PIX_FMT_RGB32:
-    return PIXEL_FORMAT_RGBA;
+    format = PIXEL_FORMAT_RGBA;
+    return true;
   case V4L2_PIX_FMT_RGB24:
-    return PIXEL_FORMAT_RGB;
+    format = PIXEL_FORMAT_RGB;
+    return true;
   case V4L2_PIX_FMT_YUV420:
-    return PIXEL_FORMAT_I420;
+    format = PIXEL_FORMAT_I420;
+    return true;
+  case V4L2_PIX_FMT_NV21:
+    format = PIXEL_FORMAT_NV21;
+    return true;
+  case V4L2_PIX_FMT_NV12:
+    format = PIXEL_FORMAT_NV12;
+    return true;
   case V4L2_PIX_FMT_YUYV:
-    return PIXEL_FORMAT_YUYV;
+    format = PIXEL_FORMAT_YUYV;
+    return true;
+  case V4L2_PIX_FMT_MJPEG:
+  case V4L2_PIX_FMT_JPEG:
+    format = PIXEL_FORMAT_MJPEG;
+    return true;
+  }
+  return false;
+}
+
+unsigned int CameraDevice::get_fourcc(PixelFormat format)
+{
+  switch(format) {
+  case PIXEL_FORMAT_RGBA:
+    return V4L2_PIX_FMT_RGB32;
+  case PIXEL_FORMAT_RGB:
+    return V4L2_PIX_FMT_RGB24;
+  case PIXEL_FORMAT_I420:
+    return V4L2_PIX_FMT_YUV420;
+  case PIXEL_FORMAT_NV21:
+    return V4L2_PIX_FMT_NV21;
+  case PIXEL_FORMAT_NV12:
+    return V4L2_PIX_FMT_NV12;
+  case PIXEL_FORMAT_YUYV:
+    return V4L2_PIX_FMT_YUYV;
+  case PIXEL_FORMAT_MJPEG:
+    return V4L2_PIX_FMT_MJPEG;
+  }
+  return 0;
+}
+
+/**
+ * @brief CameraDevice::get_color_space, defaults are resolved the way V4L2 documents them,
+ *        encodings other than BT.709 are taken as BT.601
+ */
+void CameraDevice::get_color_space(v4l2_format_t& format, DeviceInfo& dev)
+{
+  unsigned int enc = format.ycbcr_enc_;
+  if (enc == V4L2_YCBCR_ENC_DEFAULT) enc = V4L2_MAP_YCBCR_ENC_DEFAULT(format.colorspace_);
+  dev.color_space_ = (enc == V4L2_YCBCR_ENC_709 || enc == V4L2_YCBCR_ENC_XV709)
+      ? COLOR_SPACE_BT709 : COLOR_SPACE_BT601;
+
+  unsigned int quantization = format.quantization_;
+  if (quantization == V4L2_QUANTIZATION_DEFAULT) {
+    bool is_rgb = dev.format_ == PIXEL_FORMAT_RGBA || dev.format_ == PIXEL_FORMAT_RGB;
+    quantization = V4L2_MAP_QUANTIZATION_DEFAULT(is_rgb, format.colorspace_, enc);
   }
-  return PIXEL_FORMAT_YUYV;
+  dev.color_range_ = quantization == V4L2_QUANTIZATION_FULL_RANGE ? COLOR_RANGE_FULL : COLOR_RANGE_LIMITED;
 }
@@ -0,0 +1,152 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Andy Young
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "camera_group.h"
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+static const int MAX_EPOLL_EVENTS = 16;
+
+CameraGroup::CameraGroup() : camera_mutex_(), cameras_()
+{
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  epoll_event event;
+  event.events = EPOLLIN;
+  event.data.ptr = nullptr; // stands for wakeup
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &event);
+}
+
+CameraGroup::~CameraGroup()
+{
+  stop();
+  cameras_.clear();
+  if (wakeup_fd_ >= 0) close(wakeup_fd_);
+  if (epoll_fd_ >= 0) close(epoll_fd_);
+  wakeup_fd_ = -1;
+  epoll_fd_ = -1;
+}
+
+int CameraGroup::add_camera(CameraDevice* camera, FrameCallback callback)
+{
+  if (!camera || camera->get_fd() < 0) return -1;
+
+  std::unique_lock<std::mutex> lock(camera_mutex_);
+  if (cameras_.find(camera) != cameras_.end()) {
+    cameras_[camera] = callback;
+    return 0;
+  }
+  epoll_event event;
+  event.events = EPOLLIN;
+  event.data.ptr = camera;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, camera->get_fd(), &event) < 0) {
+    return -1;
+  }
+  cameras_[camera] = callback;
+  return 0;
+}
+
+int CameraGroup::remove_camera(CameraDevice* camera)
+{
+  std::unique_lock<std::mutex> lock(camera_mutex_);
+  if (cameras_.find(camera) == cameras_.end()) return -1;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, camera->get_fd(), nullptr);
+  cameras_.erase(camera);
+  return 0;
+}
+
+void CameraGroup::start()
+{
+  if (is_running_ || epoll_fd_ < 0) return;
+  is_running_ = true;
+  pthread_create(&capture_thread_, nullptr, capture_loop, this);
+}
+
+void CameraGroup::stop()
+{
+  if (!is_running_) return;
+  is_running_ = false;
+  uint64_t value = 1;
+  if (write(wakeup_fd_, &value, sizeof(value)) < 0) {
+    // counter overflowed, loop is being woken anyway
+  }
+  pthread_join(capture_thread_, nullptr);
+}
+
+void CameraGroup::dispatch_frame(CameraDevice* camera, unsigned int events)
+{
+  std::unique_lock<std::mutex> lock(camera_mutex_);
+  auto iter = cameras_.find(camera);
+  if (iter == cameras_.end()) return; // removed after epoll_wait returned
+
+  unsigned char* buffer = nullptr;
+  int length = 0;
+  if (events & EPOLLIN) {
+    length = camera->grab_frame(buffer);
+    if (length == 0) {
+      // fd is level-triggered, a buffer left queued (frames lent out, decoder busy)
+      // would wake the loop again at once, so it is dropped
+      length = camera->drop_frame();
+      if (length >= 0) return;
+    }
+  } else if (events & (EPOLLERR | EPOLLHUP)) {
+    length = -1;
+  }
+
+  if (length < 0) {
+    // device is gone (e.g. unplugged), stop listening to avoid spinning on it
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, camera->get_fd(), nullptr);
+    FrameCallback callback = iter->second;
+    cameras_.erase(iter);
+    if (callback) callback(camera, nullptr, length);
+    return;
+  }
+  if (iter->second) iter->second(camera, buffer, length);
+}
+
+void* CameraGroup::capture_loop(void* data)
+{
+  CameraGroup* group = (CameraGroup *)data;
+  epoll_event events[MAX_EPOLL_EVENTS];
+
+  while (group->is_running_) {
+    int count = epoll_wait(group->epoll_fd_, events, MAX_EPOLL_EVENTS, -1);
+    if (count < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    for (int i = 0; i < count && group->is_running_; i++) {
+      if (!events[i].data.ptr) {
+        uint64_t value = 0;
+        if (read(group->wakeup_fd_, &value, sizeof(value)) < 0) {
+          // already drained
+        }
+        continue;
+      }
+      group->dispatch_frame((CameraDevice *)events[i].data.ptr, events[i].events);
+    }
+  }
+  return nullptr;
+}
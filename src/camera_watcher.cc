@@ -0,0 +1,129 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Andy Young
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "camera_watcher.h"
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// sysfs sends no inotify events, nodes appearing and vanishing in devtmpfs tell hotplug
+static const char* WATCH_DIR = "/dev";
+static const char* VIDEO_NODE_PREFIX = "video";
+
+CameraWatcher::CameraWatcher()
+{
+
+}
+
+CameraWatcher::~CameraWatcher()
+{
+  stop();
+}
+
+int CameraWatcher::start(EventCallback callback)
+{
+  if (is_running_) return 0;
+
+  inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd_ < 0) return -1;
+  // udev creates the node first and fixes its permission later, watch attributes as well
+  int watch = inotify_add_watch(inotify_fd_, WATCH_DIR, IN_CREATE | IN_DELETE | IN_ATTRIB);
+  wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (watch < 0 || wakeup_fd_ < 0) {
+    stop();
+    return -1;
+  }
+
+  callback_ = callback;
+  // warm up the cache so that events are computed against the current device list
+  CameraDevice().enum_devices();
+
+  is_running_ = true;
+  pthread_create(&watch_thread_, nullptr, watch_loop, this);
+  return 0;
+}
+
+void CameraWatcher::stop()
+{
+  if (is_running_) {
+    is_running_ = false;
+    uint64_t value = 1;
+    if (write(wakeup_fd_, &value, sizeof(value)) < 0) {
+      // counter overflowed, loop is being woken anyway
+    }
+    pthread_join(watch_thread_, nullptr);
+  }
+  if (inotify_fd_ >= 0) close(inotify_fd_);
+  if (wakeup_fd_ >= 0) close(wakeup_fd_);
+  inotify_fd_ = -1;
+  wakeup_fd_ = -1;
+}
+
+void CameraWatcher::process_events()
+{
+  char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  ssize_t len = 0;
+  while ((len = read(inotify_fd_, buffer, sizeof(buffer))) > 0) {
+    for (char* cur = buffer; cur < buffer + len; ) {
+      struct inotify_event* event = (struct inotify_event *) cur;
+      cur += sizeof(struct inotify_event) + event->len;
+      if (!event->len || strncmp(event->name, VIDEO_NODE_PREFIX, strlen(VIDEO_NODE_PREFIX))) {
+        continue;
+      }
+
+      DeviceInfo dev;
+      if (event->mask & IN_DELETE) {
+        if (CameraDevice::remove_cached_device(event->name, dev) && callback_) {
+          callback_(EVENT_TYPE_REMOVED, dev);
+        }
+      } else if (event->mask & (IN_CREATE | IN_ATTRIB)) {
+        if (CameraDevice::add_cached_device(event->name, dev) && callback_) {
+          callback_(EVENT_TYPE_ADDED, dev);
+        }
+      }
+    }
+  }
+}
+
+void* CameraWatcher::watch_loop(void* data)
+{
+  CameraWatcher* watcher = (CameraWatcher *)data;
+  struct pollfd fds[2];
+  fds[0].fd = watcher->inotify_fd_;
+  fds[0].events = POLLIN;
+  fds[1].fd = watcher->wakeup_fd_;
+  fds[1].events = POLLIN;
+
+  while (watcher->is_running_) {
+    int count = poll(fds, 2, -1);
+    if (count < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    if (fds[0].revents & POLLIN) watcher->process_events();
+  }
+  return nullptr;
+}
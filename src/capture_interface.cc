@@ -0,0 +1,42 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Andy Young
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "capture_interface.h"
+#include "frame.h"
+#include <algorithm>
+
+int ICaptureDevice::grab_frame(Frame* &frame)
+{
+  frame = nullptr;
+  unsigned char* buffer = nullptr;
+  int len = grab_frame(buffer);
+  if (len <= 0 || !buffer) return len;
+
+  DeviceInfo& dev = get_cur_device();
+  if (!frame_pool_) frame_pool_ = FramePool::create();
+  frame = frame_pool_->acquire(dev.width_, dev.height_, dev.format_);
+  frame->set_length(std::min(len, frame->get_length())); // compressed frames are shorter
+  memcpy(frame->get_data(), buffer, frame->get_length());
+  frame->set_timestamp(get_monotonic_us());
+  return len;
+}
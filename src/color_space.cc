@@ -0,0 +1,83 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Andy Young
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "color_space.h"
+
+void get_yuv_to_rgb_coefficients(ColorSpace space, ColorRange range, float matrix[9], float offset[3])
+{
+  // luma weights of red and blue
+  float kr = space == COLOR_SPACE_BT709 ? 0.2126f : 0.299f;
+  float kb = space == COLOR_SPACE_BT709 ? 0.0722f : 0.114f;
+  float kg = 1.0f - kr - kb;
+  // limited range keeps luma in [16, 235] and chroma in [16, 240]
+  bool is_full = range == COLOR_RANGE_FULL;
+  float y_scale = is_full ? 1.0f : 255.0f / 219.0f;
+  float c_scale = is_full ? 1.0f : 255.0f / 224.0f;
+
+  // column of y
+  matrix[0] = y_scale;
+  matrix[1] = y_scale;
+  matrix[2] = y_scale;
+  // column of u
+  matrix[3] = 0.0f;
+  matrix[4] = -2.0f * kb * (1.0f - kb) / kg * c_scale;
+  matrix[5] = 2.0f * (1.0f - kb) * c_scale;
+  // column of v
+  matrix[6] = 2.0f * (1.0f - kr) * c_scale;
+  matrix[7] = -2.0f * kr * (1.0f - kr) / kg * c_scale;
+  matrix[8] = 0.0f;
+
+  offset[0] = is_full ? 0.0f : 16.0f / 255.0f;
+  offset[1] = 128.0f / 255.0f;
+  offset[2] = 128.0f / 255.0f;
+}
+
+void get_rgb_to_yuv_coefficients(ColorSpace space, ColorRange range, float matrix[9], float offset[3])
+{
+  float kr = space == COLOR_SPACE_BT709 ? 0.2126f : 0.299f;
+  float kb = space == COLOR_SPACE_BT709 ? 0.0722f : 0.114f;
+  float kg = 1.0f - kr - kb;
+  bool is_full = range == COLOR_RANGE_FULL;
+  float y_scale = is_full ? 1.0f : 219.0f / 255.0f;
+  float c_scale = is_full ? 1.0f : 224.0f / 255.0f;
+  // u = (b - y) / (2 * (1 - kb)), v = (r - y) / (2 * (1 - kr))
+  float u_scale = c_scale / (2.0f * (1.0f - kb));
+  float v_scale = c_scale / (2.0f * (1.0f - kr));
+
+  // column of r
+  matrix[0] = kr * y_scale;
+  matrix[1] = -kr * u_scale;
+  matrix[2] = (1.0f - kr) * v_scale;
+  // column of g
+  matrix[3] = kg * y_scale;
+  matrix[4] = -kg * u_scale;
+  matrix[5] = -kg * v_scale;
+  // column of b
+  matrix[6] = kb * y_scale;
+  matrix[7] = (1.0f - kb) * u_scale;
+  matrix[8] = -kb * v_scale;
+
+  offset[0] = is_full ? 0.0f : 16.0f / 255.0f;
+  offset[1] = 128.0f / 255.0f;
+  offset[2] = 128.0f / 255.0f;
+}
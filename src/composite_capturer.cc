@@ -49,6 +49,7 @@ const std::vector<DeviceInfo> CompositeCapturer::enum_devices()
 
 int CompositeCapturer::bind_device(DeviceInfo dev)
 {
+  blended_buffer_ = nullptr;
   if (cursor_cap_device_) {
     // todo: maybe use window (dev.dev_id_) of dev
     DeviceInfo empty;
@@ -60,6 +61,7 @@ int CompositeCapturer::bind_device(DeviceInfo dev)
 
 int CompositeCapturer::unbind_device()
 {
+  blended_buffer_ = nullptr;
   if (cursor_cap_device_) cursor_cap_device_->unbind_device();
   return window_cap_device_->unbind_device();
 }
@@ -69,44 +71,107 @@ DeviceInfo& CompositeCapturer::get_cur_device()
     return window_cap_device_->get_cur_device();
 }
 
+void CompositeCapturer::restore_cursor_background()
+{
+  if (!blended_buffer_) return;
+  int wnd_width = window_cap_device_->get_cur_device().width_;
+  for (int y = 0; y < background_rect_.height_; y++) {
+    memcpy(((int*) blended_buffer_) + (background_rect_.y_ + y) * wnd_width + background_rect_.x_,
+           cursor_background_.data() + y * background_rect_.width_, background_rect_.width_ * sizeof(int));
+  }
+  blended_buffer_ = nullptr;
+}
+
+void CompositeCapturer::blend_cursor(unsigned char* buffer, unsigned char* cursor_buffer)
+{
+  int wnd_width = window_cap_device_->get_cur_device().width_;
+  int wnd_height = window_cap_device_->get_cur_device().height_;
+  int curs_width = cursor_cap_device_->get_cur_device().width_;
+  int curs_height = cursor_cap_device_->get_cur_device().height_;
+  int offset_x = cursor_cap_device_->get_cur_device().pos_x_ - window_cap_device_->get_cur_device().pos_x_;
+  int offset_y = cursor_cap_device_->get_cur_device().pos_y_ - window_cap_device_->get_cur_device().pos_y_;
+  int start_x = std::max(0, -offset_x);
+  int start_y = std::max(0, -offset_y);
+  int end_x = std::min(curs_width, wnd_width - offset_x);
+  int end_y = std::min(curs_height, wnd_height - offset_y);
+  if (end_x <= start_x || end_y <= start_y) return;
+
+  // keep pixels under the cursor, window buffer might be reused without refetching
+  background_rect_.x_ = start_x + offset_x;
+  background_rect_.y_ = start_y + offset_y;
+  background_rect_.width_ = end_x - start_x;
+  background_rect_.height_ = end_y - start_y;
+  cursor_background_.resize(background_rect_.width_ * background_rect_.height_);
+  for (int y = 0; y < background_rect_.height_; y++) {
+    memcpy(cursor_background_.data() + y * background_rect_.width_,
+           ((int*) buffer) + (background_rect_.y_ + y) * wnd_width + background_rect_.x_,
+           background_rect_.width_ * sizeof(int));
+  }
+  blended_buffer_ = buffer;
+
+  for (int y = start_y; y < end_y; y++) {
+    for (int x = start_x; x < end_x; x++) {
+      int& wnd_pixel = ((int*) buffer)[(y + offset_y) * wnd_width + (x + offset_x)];
+      int& curs_pixel = ((int*) cursor_buffer)[y * curs_width + x];
+      uint8_t curs_alpha = (uint8_t)(curs_pixel >> 24);
+      if (curs_alpha == 0) {
+        continue;
+      } else if (curs_alpha == 255) {
+        wnd_pixel = curs_pixel;
+      } else { // do blending
+        /* pixel values from XFixesGetCursorImage come premultiplied by alpha */
+        uint8_t r = (uint8_t) (curs_pixel >> 0) + ((uint8_t) (wnd_pixel >> 0) * (255 - curs_alpha) + 255/2) / 255;
+        uint8_t g = (uint8_t) (curs_pixel >> 8) + ((uint8_t) (wnd_pixel >> 8) * (255 - curs_alpha) + 255/2) / 255;
+        uint8_t b = (uint8_t) (curs_pixel >> 16) + ((uint8_t) (wnd_pixel >> 16) * (255 - curs_alpha) + 255/2) / 255;
+        wnd_pixel = (int) r | ((int) g << 8) | ((int) b << 16) | ((int) 0xff << 24);
+      }
+    }
+  }
+}
+
 int CompositeCapturer::grab_frame(unsigned char *&buffer)
 {
+  // take the last cursor off, the window capturer may skip refetching unchanged content
+  restore_cursor_background();
   int len = window_cap_device_->grab_frame(buffer);
   if (len < 0) return len;
 
   if (is_cursor_enabled_) {
     unsigned char* cursor_buffer = nullptr;
     int state = cursor_cap_device_->grab_frame(cursor_buffer);
-    if (len == 0 && state == 0) return 0; // nothing changed
+    if (cursor_buffer) blend_cursor(buffer, cursor_buffer);
+    if (len == 0 && state > 0) { // only cursor changed
+      DeviceInfo& wnd = window_cap_device_->get_cur_device();
+      len = wnd.width_ * wnd.height_ * sizeof(int);
+    }
+  }
+  if (len > 0) buffer = deliver_to_provider(buffer, len);
+  return len;
+}
 
-    // blend cursor icon with window
-    int wnd_width = window_cap_device_->get_cur_device().width_;
-    int wnd_height = window_cap_device_->get_cur_device().height_;
-    int curs_width = cursor_cap_device_->get_cur_device().width_;
-    int curs_height = cursor_cap_device_->get_cur_device().height_;
-    int offset_x = cursor_cap_device_->get_cur_device().pos_x_ - window_cap_device_->get_cur_device().pos_x_;
-    int offset_y = cursor_cap_device_->get_cur_device().pos_y_ - window_cap_device_->get_cur_device().pos_y_;
-    int start_x = std::max(0, -offset_x);
-    int start_y = std::max(0, -offset_y);
-    int end_x = std::min(curs_width, wnd_width - offset_x);
-    int end_y = std::min(curs_height, wnd_height - offset_y);
-    for (int y = start_y; y < end_y; y++) {
-      for (int x = start_x; x < end_x; x++) {
-        int& wnd_pixel = ((int*) buffer)[(y + offset_y) * wnd_width + (x + offset_x)];
-        int& curs_pixel = ((int*) cursor_buffer)[y * curs_width + x];
-        uint8_t curs_alpha = (uint8_t)(curs_pixel >> 24);
-        if (curs_alpha == 0) {
-          continue;
-        } else if (curs_alpha == 255) {
-          wnd_pixel = curs_pixel;
-        } else { // do blending
-          /* pixel values from XFixesGetCursorImage come premultiplied by alpha */
-          uint8_t r = (uint8_t) (curs_pixel >> 0) + ((uint8_t) (wnd_pixel >> 0) * (255 - curs_alpha) + 255/2) / 255;
-          uint8_t g = (uint8_t) (curs_pixel >> 8) + ((uint8_t) (wnd_pixel >> 8) * (255 - curs_alpha) + 255/2) / 255;
-          uint8_t b = (uint8_t) (curs_pixel >> 16) + ((uint8_t) (wnd_pixel >> 16) * (255 - curs_alpha) + 255/2) / 255;
-          wnd_pixel = (int) r | ((int) g << 8) | ((int) b << 16) | ((int) 0xff << 24);
-        }
-      }
+void CompositeCapturer::set_buffer_provider(IBufferProvider* provider)
+{
+  buffer_provider_ = provider;
+  window_cap_device_->set_buffer_provider(nullptr);
+}
+
+int CompositeCapturer::grab_frame(unsigned char *&buffer, std::vector<Rect>& dirty)
+{
+  Rect last_cursor_rect;
+  if (blended_buffer_) last_cursor_rect = background_rect_;
+  restore_cursor_background();
+  int len = window_cap_device_->grab_frame(buffer, dirty);
+  if (len < 0) return len;
+
+  if (is_cursor_enabled_) {
+    unsigned char* cursor_buffer = nullptr;
+    int state = cursor_cap_device_->grab_frame(cursor_buffer);
+    if (cursor_buffer) blend_cursor(buffer, cursor_buffer);
+    if (state > 0) { // both the area cursor left and the one it covers now need refreshing
+      if (last_cursor_rect.width_ > 0) dirty.push_back(last_cursor_rect);
+      if (blended_buffer_) dirty.push_back(background_rect_);
+      len += (last_cursor_rect.width_ * last_cursor_rect.height_
+           + (blended_buffer_ ? background_rect_.width_ * background_rect_.height_ : 0)) * sizeof(int);
     }
   }
   return len;
@@ -106,8 +106,8 @@ int CursorCapturer::grab_frame(unsigned char *&buffer)
   cur_image_ = XFixesGetCursorImage(cur_display_);
   if (!cur_image_) return 0;
 
-  bool is_pos_changed = cur_dev_.pos_x_ != cur_image_->x
-                      || cur_dev_.pos_y_ != cur_image_->y
+  bool is_pos_changed = cur_dev_.pos_x_ != cur_image_->x - cur_image_->xhot
+                      || cur_dev_.pos_y_ != cur_image_->y - cur_image_->yhot
                       || cur_dev_.width_ != cur_image_->width
                       || cur_dev_.height_ != cur_image_->height;
   cur_dev_.pos_x_ = cur_image_->x - cur_image_->xhot;
@@ -24,6 +24,7 @@
 #include "egl_core.h"
 #include <iostream>
 #include <cassert>
+#include <cstring>
 #include "x_window_env.h"
 
 /**
@@ -306,3 +307,62 @@ const char* EglCore::query_string(int what) {
 int EglCore::get_gl_version() {
   return gl_version_;
 }
+
+/**
+ * 是否支持某个EGL扩展
+ * @param extension
+ * @return
+ */
+bool EglCore::has_extension(const char* extension) {
+  const char* extensions = query_string(EGL_EXTENSIONS);
+  if (!extensions || !extension) return false;
+  size_t len = strlen(extension);
+  for (const char* cur = strstr(extensions, extension); cur; cur = strstr(cur + len, extension)) {
+    if ((cur == extensions || cur[-1] == ' ') && (cur[len] == ' ' || cur[len] == '\0')) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * 从dmabuf创建EGLImage, 不支持时返回EGL_NO_IMAGE_KHR
+ * @param fd
+ * @param width
+ * @param height
+ * @param fourcc drm格式
+ * @param offset
+ * @param pitch
+ * @return
+ */
+EGLImageKHR EglCore::create_dmabuf_image(int fd, int width, int height, int fourcc, int offset, int pitch) {
+  if (!create_image_) {
+    if (!has_extension("EGL_EXT_image_dma_buf_import")) return EGL_NO_IMAGE_KHR;
+    create_image_ = (PFNEGLCREATEIMAGEKHRPROC) eglGetProcAddress("eglCreateImageKHR");
+    destroy_image_ = (PFNEGLDESTROYIMAGEKHRPROC) eglGetProcAddress("eglDestroyImageKHR");
+    if (!create_image_ || !destroy_image_) {
+      create_image_ = nullptr;
+      return EGL_NO_IMAGE_KHR;
+    }
+  }
+  const EGLint attribs[] = {
+    EGL_WIDTH, width,
+    EGL_HEIGHT, height,
+    EGL_LINUX_DRM_FOURCC_EXT, fourcc,
+    EGL_DMA_BUF_PLANE0_FD_EXT, fd,
+    EGL_DMA_BUF_PLANE0_OFFSET_EXT, offset,
+    EGL_DMA_BUF_PLANE0_PITCH_EXT, pitch,
+    EGL_NONE
+  };
+  return create_image_(egl_display_, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, nullptr, attribs);
+}
+
+/**
+ * 销毁EGLImage
+ * @param image
+ */
+void EglCore::release_image(EGLImageKHR image) {
+  if (destroy_image_ && image != EGL_NO_IMAGE_KHR) {
+    destroy_image_(egl_display_, image);
+  }
+}
@@ -0,0 +1,115 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Andy Young
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "frame.h"
+#include <time.h>
+
+Frame* Frame::create(int width, int height, Cacheable::Attributes* attributes)
+{
+  Frame* frame = new Frame(width, height, (Attributes*) attributes);
+  frame->length_ = get_frame_length(frame->attributes_.format_, width, height, frame->attributes_.stride_);
+  frame->data_ = (unsigned char*) malloc(frame->length_);
+  return frame;
+}
+
+Frame* Frame::wrap(unsigned char* data, int length, int width, int height,
+                   Attributes* attributes, std::function<void()> on_release)
+{
+  Frame* frame = new Frame(width, height, attributes);
+  frame->data_ = data;
+  frame->length_ = length;
+  frame->on_release_ = on_release;
+  return frame;
+}
+
+int Frame::get_frame_length(PixelFormat format, int width, int height, int stride)
+{
+  switch (format) {
+  case PIXEL_FORMAT_RGBA:
+    return (stride ? stride : width * 4) * height;
+  case PIXEL_FORMAT_RGB:
+    return (stride ? stride : width * 3) * height;
+  case PIXEL_FORMAT_I420:
+  case PIXEL_FORMAT_NV12:
+  case PIXEL_FORMAT_NV21:
+    stride = stride ? stride : width;
+    return stride * height + ((stride + 1) >> 1) * ((height + 1) >> 1) * 2;
+  default: // YUYV, MJPEG never grows beyond it
+    return (stride ? stride : width * 2) * height;
+  }
+}
+
+Frame::Frame(int width, int height, Attributes* attributes)
+: attributes_(*attributes), ref_count_(1)
+{
+  width_ = width;
+  height_ = height;
+}
+
+Frame::~Frame()
+{
+  if (on_release_) {
+    on_release_();
+  } else {
+    free(data_);
+  }
+  data_ = nullptr;
+}
+
+void Frame::release()
+{
+  if (--ref_count_ > 0) return;
+  if (pool_) {
+    pool_->recycle(this);
+  } else {
+    delete this;
+  }
+}
+
+Frame* FramePool::acquire(int width, int height, PixelFormat format, int stride)
+{
+  Frame::Attributes attr;
+  attr.format_ = format;
+  attr.stride_ = stride;
+  Frame* frame = cacher_.fetch_object(width, height, &attr);
+  frame->ref_count_ = 1;
+  frame->timestamp_us_ = 0;
+  frame->length_ = Frame::get_frame_length(format, width, height, stride);
+  frame->pool_ = shared_from_this();
+  return frame;
+}
+
+void FramePool::recycle(Frame* frame)
+{
+  // cached frames must not keep the pool alive, hold it until returned
+  std::shared_ptr<FramePool> self = frame->pool_;
+  frame->pool_.reset();
+  cacher_.return_object(frame);
+}
+
+int64_t get_monotonic_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
@@ -0,0 +1,123 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Andy Young
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "frame_queue.h"
+#include <algorithm>
+#include <chrono>
+
+FrameQueue::FrameQueue(DropPolicy policy, int capacity)
+: latest_(nullptr), head_(0), tail_(0), is_closed_(false), is_producer_waiting_(false),
+  pushed_frames_(0), dropped_frames_(0)
+{
+  set_policy(policy, capacity);
+}
+
+FrameQueue::~FrameQueue()
+{
+  clear();
+}
+
+void FrameQueue::set_policy(DropPolicy policy, int capacity, int block_timeout_ms)
+{
+  clear();
+  policy_ = policy;
+  block_timeout_ms_ = block_timeout_ms;
+  slots_.assign(policy == DROP_POLICY_LATEST ? 0 : std::max(capacity, 1) + 1, nullptr);
+  head_ = 0;
+  tail_ = 0;
+}
+
+bool FrameQueue::push(Frame* frame)
+{
+  if (!frame) return false;
+  pushed_frames_++;
+  if (is_closed_) {
+    frame->release();
+    dropped_frames_++;
+    return false;
+  }
+
+  if (policy_ == DROP_POLICY_LATEST) {
+    Frame* old = latest_.exchange(frame, std::memory_order_acq_rel);
+    if (old) {
+      old->release();
+      dropped_frames_++;
+    }
+    return true;
+  }
+
+  unsigned int tail = tail_.load(std::memory_order_relaxed);
+  unsigned int next = (tail + 1) % slots_.size();
+  if (next == head_.load(std::memory_order_acquire)) {
+    bool is_full = true;
+    if (policy_ == DROP_POLICY_BLOCK) {
+      // flag and head are both sequentially consistent, consumer either frees the slot
+      // before the check below or sees the flag and wakes us up
+      std::unique_lock<std::mutex> lock(wait_mutex_);
+      is_producer_waiting_ = true;
+      is_full = !wait_cv_.wait_for(lock, std::chrono::milliseconds(block_timeout_ms_), [&] {
+        return next != head_.load() || is_closed_;
+      }) || is_closed_;
+      is_producer_waiting_ = false;
+    }
+    if (is_full) {
+      frame->release();
+      dropped_frames_++;
+      return false;
+    }
+  }
+  slots_[tail] = frame;
+  tail_.store(next, std::memory_order_release);
+  return true;
+}
+
+Frame* FrameQueue::pop()
+{
+  if (policy_ == DROP_POLICY_LATEST) {
+    return latest_.exchange(nullptr, std::memory_order_acq_rel);
+  }
+
+  unsigned int head = head_.load(std::memory_order_relaxed);
+  if (head == tail_.load(std::memory_order_acquire)) return nullptr;
+  Frame* frame = slots_[head];
+  slots_[head] = nullptr;
+  head_.store((head + 1) % slots_.size());
+  if (is_producer_waiting_) {
+    std::lock_guard<std::mutex> lock(wait_mutex_);
+    wait_cv_.notify_one();
+  }
+  return frame;
+}
+
+void FrameQueue::clear()
+{
+  Frame* frame = nullptr;
+  while ((frame = pop()) != nullptr) frame->release();
+}
+
+void FrameQueue::set_closed(bool is_closed)
+{
+  is_closed_ = is_closed;
+  std::lock_guard<std::mutex> lock(wait_mutex_);
+  wait_cv_.notify_all();
+}
@@ -22,7 +22,9 @@
  * SOFTWARE.
  */
 #include "gl_renderer.h"
+#include "color_space.h"
 #include <cstring>
+#include <sys/stat.h>
 #include <cstdlib>
 #include <algorithm>
 #include <mutex>
@@ -42,6 +44,20 @@ static const float TEXTURE_COORDS[8] = {
   0, 0, 1, 0, 0, 1, 1, 1,
 };
 
+static const int MAX_DIRTY_RECTS = 32;
+static const size_t MAX_DMABUF_TEXTURES = 32; // VIDEO_MAX_FRAME
+// storage for a size changing frame (e.g. a window being dragged) is rounded up to it
+static const int TEXTURE_SIZE_BUCKET = 128;
+
+static int bucket_size(int size)
+{
+  return (size + TEXTURE_SIZE_BUCKET - 1) / TEXTURE_SIZE_BUCKET * TEXTURE_SIZE_BUCKET;
+}
+
+#define DRM_FOURCC(a, b, c, d) ((int)(a) | ((int)(b) << 8) | ((int)(c) << 16) | ((int)(d) << 24))
+// view on a YUYV frame matching the pixel path: Y0 U Y1 V as rgba of half width
+static const int DRM_FORMAT_ABGR8888 = DRM_FOURCC('A', 'B', '2', '4');
+
 static char* read_string(const char* path)
 {
   if (!path) return nullptr;
@@ -74,6 +90,8 @@ GLRenderer::GLRenderer(RenderCtrl* render_ctrl)
   render_ctrl_ = render_ctrl;
   pthread_mutex_init(&pixel_mutex_, nullptr);
   memcpy(mvp_matrix_, IDENTITY_MATRIX, 16 * sizeof(float));
+  memcpy(tex_coords_, TEXTURE_COORDS, 8 * sizeof(float));
+  set_color_space(COLOR_SPACE_BT601, COLOR_RANGE_FULL);
 }
 
 GLRenderer::~GLRenderer()
@@ -86,15 +104,18 @@ void GLRenderer::bind_window_for_source(void* win, std::string& src_id)
   source_id_ = src_id;
   is_window_changed = win != cur_window_;
   cur_window_ = win;
+  render_ctrl_->request_render();
 }
 
 int GLRenderer::setup()
 {
+  frame_queue_.set_closed(false);
   return setup_program();
 }
 
 int GLRenderer::release()
 {
+  release_dmabuf_textures();
   if (input_texture_) {
     delete input_texture_;
     input_texture_ = nullptr;
@@ -103,10 +124,22 @@ int GLRenderer::release()
     delete input_texture_uv_;
     input_texture_uv_ = nullptr;
   }
-  if (pixel_buffer_object_) {
-    glDeleteBuffers(1, &pixel_buffer_object_);
-    pixel_buffer_object_ = 0;
+  if (input_texture_v_) {
+    delete input_texture_v_;
+    input_texture_v_ = nullptr;
   }
+  frame_queue_.set_closed(true); // nothing pops any more, producer must not wait on it
+  frame_queue_.clear();
+  release_convert_pass();
+  if (convert_program_) {
+    delete convert_program_;
+    convert_program_ = nullptr;
+  }
+  mapped_buffer_ = nullptr; // deleting buffers unmaps them
+  is_mapped_acquired_ = false;
+  is_mapped_committed_ = false;
+  committed_buffer_ = nullptr;
+  release_pixel_buffer();
   if (program_) {
     delete program_;
     program_ = nullptr;
@@ -121,36 +154,350 @@ int GLRenderer::upload_texture(uint8_t **data, int num_channel, int width, int h
   if (!data || !*data) return -1;
 
   pthread_mutex_lock(&pixel_mutex_);
+  if (*data == committed_buffer_) {
+    // committed through commit_buffer already, the slot may have been unmapped since
+    committed_buffer_ = nullptr;
+    pthread_mutex_unlock(&pixel_mutex_);
+    return 0;
+  }
   check_texture_size(width, height);
   pixel_buffer_ = *data;
+  pending_dmabuf_fd_ = -1;
+  is_full_update_ = true;
   is_pixel_updated = true;
 //  if (input_texture_) input_texture_->upload_pixels(pixel_buffer_);
 //  if (input_texture_uv_) input_texture_uv_->upload_pixels(pixel_buffer_);
 //  is_pixel_updated = true;
   pthread_mutex_unlock(&pixel_mutex_);
+  render_ctrl_->request_render();
+  return 0;
+}
+
+int GLRenderer::upload_texture(uint8_t **data, int, int width, int height,
+                               const std::vector<Rect>& dirty)
+{
+  if (!data || !*data) return -1;
+
+  pthread_mutex_lock(&pixel_mutex_);
+  if (*data == committed_buffer_) {
+    // committed through commit_buffer already, the slot may have been unmapped since
+    committed_buffer_ = nullptr;
+    pthread_mutex_unlock(&pixel_mutex_);
+    return 0;
+  }
+  if (check_texture_size(width, height) || *data != pixel_buffer_) {
+    is_full_update_ = true;
+  }
+  pixel_buffer_ = *data;
+  pending_dmabuf_fd_ = -1;
+  if (!is_full_update_) {
+    // rectangles pile up until the render thread picks them
+    dirty_rects_.insert(dirty_rects_.end(), dirty.begin(), dirty.end());
+    if (dirty_rects_.size() > MAX_DIRTY_RECTS) is_full_update_ = true;
+  }
+  is_pixel_updated = true;
+  pthread_mutex_unlock(&pixel_mutex_);
+  render_ctrl_->request_render();
+  return 0;
+}
+
+int GLRenderer::upload_frame(Frame* frame)
+{
+  if (!frame) return -1;
+  if (!is_format_drawable(frame->get_format())) {
+    frame->release();
+    return 1;
+  }
+  bool is_queued = frame_queue_.push(frame);
+  if (is_queued) render_ctrl_->request_render();
+  return is_queued ? 0 : 1;
+}
+
+void GLRenderer::set_frame_policy(FrameQueue::DropPolicy policy, int capacity)
+{
+  frame_queue_.set_policy(policy, capacity);
+}
+
+/**
+ * @brief GLRenderer::upload_queued_frame, take one frame from the queue and upload it,
+ *        all done in render thread, producer is never waited for
+ * @return 1 if a frame has been uploaded
+ */
+int GLRenderer::upload_queued_frame()
+{
+  Frame* frame = frame_queue_.pop();
+  if (!frame) return 0;
+  if (frame->get_format() != tex_format_) {
+    // program and textures are made for tex_format_, set_texture_format first
+    frame->release();
+    return 0;
+  }
+
+  check_texture_size(frame->get_width(), frame->get_height());
+  dmabuf_texture_ = nullptr;
+  if (!is_pbo_supported()) {
+    upload_from_client(frame->get_data(), frame->get_stride());
+    frame->release();
+    return 1;
+  }
+  pthread_mutex_lock(&pixel_mutex_);
+  release_mapped_buffer(); // slot is about to be filled here
+  pthread_mutex_unlock(&pixel_mutex_);
+  setup_pixel_buffer();
+  GLuint pbo = fill_pixel_buffer(frame->get_data(), frame->get_stride());
+  frame->release(); // copied, back to capturer
+  upload_from_pixel_buffer(pbo);
+  return 1;
+}
+
+int GLRenderer::upload_dmabuf(int fd, int width, int height, int stride)
+{
+  struct stat st;
+  if (fd < 0 || tex_format_ != PIXEL_FORMAT_YUYV
+   || !render_ctrl_->is_dmabuf_supported() || is_dmabuf_failed_ || fstat(fd, &st) < 0) {
+    return -1;
+  }
+
+  pthread_mutex_lock(&pixel_mutex_);
+  check_texture_size(width, height);
+  pending_dmabuf_fd_ = fd;
+  pending_dmabuf_id_ = DmabufId(st.st_dev, st.st_ino);
+  dmabuf_stride_ = stride;
+  is_pixel_updated = true;
+  pthread_mutex_unlock(&pixel_mutex_);
+  render_ctrl_->request_render();
+  return 0;
+}
+
+void GLRenderer::drop_dmabuf_images()
+{
+  pthread_mutex_lock(&pixel_mutex_);
+  pending_dmabuf_fd_ = -1;
+  is_dmabuf_dropped_ = true;
+  pthread_mutex_unlock(&pixel_mutex_);
+  render_ctrl_->request_render();
+}
+
+int GLRenderer::import_dmabuf_internal()
+{
+  auto iter = dmabuf_textures_.find(pending_dmabuf_id_);
+  if (iter != dmabuf_textures_.end()
+   && iter->second.texture_->get_width() == (tex_width_ >> 1)
+   && iter->second.texture_->get_height() == tex_height_) {
+    dmabuf_texture_ = &iter->second;
+    return 0;
+  }
+  if (iter != dmabuf_textures_.end()) release_dmabuf_textures(); // size changed
+  dmabuf_texture_ = nullptr;
+
+  // fd is only looked at on a miss, make sure it still refers to the buffer uploaded
+  struct stat st;
+  if (fstat(pending_dmabuf_fd_, &st) < 0
+   || DmabufId(st.st_dev, st.st_ino) != pending_dmabuf_id_) {
+    return -1;
+  }
+  if (dmabuf_textures_.size() >= MAX_DMABUF_TEXTURES) {
+    // buffers of an earlier stream nobody dropped, images would keep them alive
+    release_dmabuf_textures();
+  }
+
+  DmabufTexture tex;
+  Texture::Attributes attr = get_yuyv_attributes();
+  tex.image_ = render_ctrl_->create_dmabuf_image(pending_dmabuf_fd_, tex_width_ >> 1, tex_height_,
+                                                 DRM_FORMAT_ABGR8888, dmabuf_stride_);
+  tex.texture_ = new Texture(tex_width_ >> 1, tex_height_, &attr);
+  if (!tex.image_ || !tex.texture_->attach_egl_image(tex.image_)) {
+    delete tex.texture_;
+    render_ctrl_->release_image(tex.image_);
+    is_dmabuf_failed_ = true; // driver refused the buffer, stay on pixel path from now on
+    return -1;
+  }
+  dmabuf_texture_ = &(dmabuf_textures_[pending_dmabuf_id_] = tex);
+  return 0;
+}
+
+void GLRenderer::release_dmabuf_textures()
+{
+  for (auto& item : dmabuf_textures_) {
+    delete item.second.texture_;
+    render_ctrl_->release_image(item.second.image_);
+  }
+  dmabuf_textures_.clear();
+  dmabuf_texture_ = nullptr;
+}
+
+/**
+ * @brief GLRenderer::get_yuyv_attributes, a YUYV frame is sampled as half width RGBA (Y0 U Y1 V),
+ *        texels must not be filtered since shader picks luma by the parity of the pixel
+ */
+Texture::Attributes GLRenderer::get_yuyv_attributes()
+{
+  Texture::Attributes attr = *Texture::s_default_texture_attributes_;
+  attr.min_filter_ = GL_NEAREST;
+  attr.mag_filter_ = GL_NEAREST;
+  return attr;
+}
+
+int GLRenderer::upload_dirty_rects()
+{
+  for (const Rect& dirty : dirty_rects_) {
+    int x = std::max(dirty.x_, 0);
+    int y = std::max(dirty.y_, 0);
+    int width = std::min(dirty.x_ + dirty.width_, tex_width_) - x;
+    int height = std::min(dirty.y_ + dirty.height_, tex_height_) - y;
+    if (width <= 0 || height <= 0) continue;
+    input_texture_->upload_sub_pixels(pixel_buffer_, x, y, width, height, tex_width_);
+  }
+  dirty_rects_.clear();
   return 0;
 }
 
 int GLRenderer::upload_texture_internal()
 {
-  if (is_pixel_updated) {
+  if (is_dmabuf_dropped_) {
     pthread_mutex_lock(&pixel_mutex_);
-    setup_pixel_buffer();
-    glBindBuffer(GL_ARRAY_BUFFER, pixel_buffer_object_);
-    if (tex_format_ == PIXEL_FORMAT_RGBA) {
-      glBufferSubData(GL_ARRAY_BUFFER, 0, tex_width_ * tex_height_ * 4, pixel_buffer_);
-    } else {
-      glBufferSubData(GL_ARRAY_BUFFER, 0, tex_width_ * tex_height_ * 2, pixel_buffer_);
-    }
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    release_dmabuf_textures();
+    is_dmabuf_dropped_ = false;
+    pthread_mutex_unlock(&pixel_mutex_);
+  }
+  if (upload_queued_frame()) {
+    if (is_buffer_provided_) provide_mapped_buffer();
+    return 1;
+  }
+  if (!is_pixel_updated) {
+    if (is_buffer_provided_) provide_mapped_buffer();
+    return 0;
+  }
+
+  pthread_mutex_lock(&pixel_mutex_);
+  if (pending_dmabuf_fd_ >= 0) {
+    int res = import_dmabuf_internal();
+    is_pixel_updated = false;
+    pthread_mutex_unlock(&pixel_mutex_);
+    return res < 0 ? 0 : 1;
+  }
+  dmabuf_texture_ = nullptr;
+  if (is_mapped_committed_) {
+    // capturer wrote the frame into the mapped slot already
+    GLuint pbo = pixel_buffer_objects_[pixel_buffer_index_];
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    mapped_buffer_ = nullptr;
+    is_mapped_acquired_ = false;
+    is_mapped_committed_ = false;
     is_pixel_updated = false;
     pthread_mutex_unlock(&pixel_mutex_);
 
-    if (input_texture_) input_texture_->upload_pixel_from_pbo(pixel_buffer_object_);
-    if (input_texture_uv_) input_texture_uv_->upload_pixel_from_pbo(pixel_buffer_object_);
+    upload_from_pixel_buffer(pbo);
+    if (is_buffer_provided_) provide_mapped_buffer();
     return 1;
   }
-  return 0;
+  if (mapped_buffer_ && is_mapped_acquired_) {
+    // capturer is writing into the slot, regular path would reuse it
+    pthread_mutex_unlock(&pixel_mutex_);
+    return 0;
+  }
+  release_mapped_buffer();
+  // partial upload skips pbo, it costs what has changed rather than the resolution
+  if (!is_full_update_ && tex_format_ == PIXEL_FORMAT_RGBA
+   && input_texture_ && render_ctrl_->get_gl_version() >= 3) {
+    upload_dirty_rects();
+    is_pixel_updated = false;
+    pthread_mutex_unlock(&pixel_mutex_);
+    return 1;
+  }
+  if (!is_pbo_supported()) {
+    upload_from_client(pixel_buffer_, 0);
+    is_pixel_updated = false;
+    is_full_update_ = false;
+    dirty_rects_.clear();
+    pthread_mutex_unlock(&pixel_mutex_);
+    return 1;
+  }
+  setup_pixel_buffer();
+  GLuint pbo = fill_pixel_buffer(pixel_buffer_, 0);
+  is_pixel_updated = false;
+  is_full_update_ = false;
+  dirty_rects_.clear();
+  pthread_mutex_unlock(&pixel_mutex_);
+
+  upload_from_pixel_buffer(pbo);
+  if (is_buffer_provided_) provide_mapped_buffer();
+  return 1;
+}
+
+/**
+ * @brief GLRenderer::upload_from_pixel_buffer, upload planes from the current slot of the ring
+ *        and move on to the next slot
+ */
+void GLRenderer::upload_from_pixel_buffer(GLuint pbo)
+{
+  size_t luma_size = tex_width_ * tex_height_;
+  size_t chroma_size = ((tex_width_ + 1) >> 1) * ((tex_height_ + 1) >> 1);
+  if (input_texture_) input_texture_->upload_pixel_from_pbo(pbo);
+  switch (tex_format_) {
+  case PIXEL_FORMAT_I420:
+    input_texture_uv_->upload_pixel_from_pbo(pbo, luma_size);
+    input_texture_v_->upload_pixel_from_pbo(pbo, luma_size + chroma_size);
+    break;
+  case PIXEL_FORMAT_NV12:
+  case PIXEL_FORMAT_NV21:
+    input_texture_uv_->upload_pixel_from_pbo(pbo, luma_size);
+    break;
+  case PIXEL_FORMAT_RGBA:
+  case PIXEL_FORMAT_YUYV:
+  case PIXEL_FORMAT_RGB:
+  case PIXEL_FORMAT_MJPEG:
+    break;
+  }
+  // the slot is free again once the texture uploads above have read it
+  pixel_buffer_fences_[pixel_buffer_index_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  pixel_buffer_index_ = (pixel_buffer_index_ + 1) % NUM_PIXEL_BUFFERS;
+}
+
+/**
+ * @brief GLRenderer::upload_from_client, upload planes straight from memory of the frame,
+ *        strided frames are packed first as GLES2 has no GL_UNPACK_ROW_LENGTH
+ */
+void GLRenderer::upload_from_client(const uint8_t* pixels, int stride)
+{
+  PlaneLayout planes[3];
+  int num_planes = get_plane_layouts(stride, planes);
+  bool is_packed = true;
+  for (int i = 0; i < num_planes; i++) {
+    is_packed = is_packed && planes[i].src_stride_ == planes[i].row_size_;
+  }
+  if (!is_packed) {
+    client_pixels_.resize(get_frame_size());
+    for (int i = 0; i < num_planes; i++) {
+      const PlaneLayout& plane = planes[i];
+      for (int row = 0; row < plane.rows_; row++) {
+        memcpy(client_pixels_.data() + plane.dst_offset_ + row * plane.row_size_,
+               pixels + plane.src_offset_ + row * plane.src_stride_, plane.row_size_);
+      }
+    }
+    pixels = client_pixels_.data();
+  }
+
+  size_t luma_size = tex_width_ * tex_height_;
+  size_t chroma_size = ((tex_width_ + 1) >> 1) * ((tex_height_ + 1) >> 1);
+  if (input_texture_) input_texture_->upload_pixels(pixels);
+  switch (tex_format_) {
+  case PIXEL_FORMAT_I420:
+    input_texture_uv_->upload_pixels(pixels + luma_size);
+    input_texture_v_->upload_pixels(pixels + luma_size + chroma_size);
+    break;
+  case PIXEL_FORMAT_NV12:
+  case PIXEL_FORMAT_NV21:
+    input_texture_uv_->upload_pixels(pixels + luma_size);
+    break;
+  case PIXEL_FORMAT_RGBA:
+  case PIXEL_FORMAT_YUYV:
+  case PIXEL_FORMAT_RGB:
+  case PIXEL_FORMAT_MJPEG:
+    break;
+  }
 }
 
 int GLRenderer::pre_draw()
@@ -171,11 +518,12 @@ int GLRenderer::pre_draw()
 
 int GLRenderer::draw()
 {
-  if (!cur_window_) {
-    return 0;
+  if (!cur_window_ || !program_) {
+    return 0; // nothing is drawn for formats without a shader
   }
 
-  if (!upload_texture_internal() && !is_force_refresh_) {
+  bool is_new_frame = upload_texture_internal() > 0;
+  if (!is_new_frame && !is_force_refresh_) {
     return 0;
   }
 
@@ -193,19 +541,37 @@ int GLRenderer::draw()
   glVertexAttribPointer(vertices_handle_, 2, GL_FLOAT, 0, 0, VERTEX_COORDS);
   //纹理坐标
   glEnableVertexAttribArray(tex_coord_handle_);
-  glVertexAttribPointer(tex_coord_handle_, 2, GL_FLOAT, 0, 0, TEXTURE_COORDS);
+  glVertexAttribPointer(tex_coord_handle_, 2, GL_FLOAT, 0, 0,
+                        dmabuf_texture_ ? TEXTURE_COORDS : tex_coords_);
   //MVP矩阵
   glUniformMatrix4fv(mvp_matrix_handle_, 1, GL_FALSE, mvp_matrix_);
 
   //纹理
+  Texture* texture = input_texture_;
+  Texture* texture_uv = input_texture_uv_;
+  float sample_width = (float) tex_width_; // pixels across the texture, YUYV shader picks them by it
+  if (dmabuf_texture_) {
+    texture = dmabuf_texture_->texture_;
+  } else if (tex_format_ == PIXEL_FORMAT_YUYV) {
+    sample_width = 2.0f * texture->get_storage_width();
+  }
   glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, input_texture_->get_texture());
+  glBindTexture(GL_TEXTURE_2D, texture->get_texture());
   glUniform1i(color_map_handle_, 0);
-  if (tex_format_ == PIXEL_FORMAT_YUYV && input_texture_uv_) {
+  glUniform1f(tex_width_handle_, sample_width);
+  glUniformMatrix3fv(color_matrix_handle_, 1, GL_FALSE, color_matrix_);
+  glUniform3fv(color_offset_handle_, 1, color_offset_);
+  if (tex_format_ != PIXEL_FORMAT_RGBA && texture_uv) {
     glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, input_texture_uv_->get_texture());
+    glBindTexture(GL_TEXTURE_2D, texture_uv->get_texture());
     glUniform1i(uv_color_map_handle_, 1);
   }
+  if (tex_format_ == PIXEL_FORMAT_I420 && input_texture_v_) {
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, input_texture_v_->get_texture());
+    glUniform1i(v_color_map_handle_, 2);
+    glActiveTexture(GL_TEXTURE0);
+  }
 
   glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
   glBindTexture(GL_TEXTURE_2D, 0);
@@ -213,6 +579,7 @@ int GLRenderer::draw()
   glDisableVertexAttribArray(tex_coord_handle_);
   glUseProgram(0);
   render_ctrl_->swap_buffer(cur_window_surface_);
+  if (is_new_frame) convert_frame();
 
   post_draw();
   int error = glGetError();
@@ -233,6 +600,7 @@ void GLRenderer::set_output_size(int width, int height)
   output_width_ = width;
   output_height_ = height;
   reset_mvp_matrix();
+  render_ctrl_->request_render();
 }
 
 void GLRenderer::reset_mvp_matrix()
@@ -263,9 +631,43 @@ void GLRenderer::reset_mvp_matrix()
   }
 }
 
-void GLRenderer::set_texture_format(PixelFormat format)
+int GLRenderer::set_texture_format(PixelFormat format)
 {
   tex_format_ = format;
+  return is_format_drawable(format) ? 0 : -1;
+}
+
+/**
+ * @brief GLRenderer::is_format_drawable, formats having a shader, others are to be converted
+ *        by capturer (e.g. MJPEG decoded by CameraDevice into I420)
+ */
+bool GLRenderer::is_format_drawable(PixelFormat format)
+{
+  switch (format) {
+  case PIXEL_FORMAT_RGBA:
+  case PIXEL_FORMAT_I420:
+  case PIXEL_FORMAT_NV12:
+  case PIXEL_FORMAT_NV21:
+  case PIXEL_FORMAT_YUYV:
+    return true;
+  case PIXEL_FORMAT_RGB:
+  case PIXEL_FORMAT_MJPEG:
+    break;
+  }
+  return false;
+}
+
+void GLRenderer::set_color_space(ColorSpace space, ColorRange range)
+{
+  float matrix[9];
+  float offset[3];
+  get_yuv_to_rgb_coefficients(space, range, matrix, offset);
+  pthread_mutex_lock(&pixel_mutex_);
+  memcpy(color_matrix_, matrix, sizeof(color_matrix_));
+  memcpy(color_offset_, offset, sizeof(color_offset_));
+  is_force_refresh_ = true;
+  pthread_mutex_unlock(&pixel_mutex_);
+  render_ctrl_->request_render();
 }
 
 void GLRenderer::set_scale_type(ScaleType type)
@@ -273,6 +675,146 @@ void GLRenderer::set_scale_type(ScaleType type)
   tex_scale_type_ = type;
 }
 
+int GLRenderer::set_converted_output(PixelFormat format, ColorSpace space, ColorRange range,
+                                     ConvertedFrameCallback callback)
+{
+  if (format != PIXEL_FORMAT_NV12 && format != PIXEL_FORMAT_I420) return -1;
+
+  pthread_mutex_lock(&pixel_mutex_);
+  pending_convert_callback_ = callback;
+  pending_convert_format_ = format;
+  get_rgb_to_yuv_coefficients(space, range, pending_convert_matrix_, pending_convert_offset_);
+  is_convert_changed_ = true;
+  pthread_mutex_unlock(&pixel_mutex_);
+  return 0;
+}
+
+int GLRenderer::setup_convert_pass(int width, int height)
+{
+  if (!convert_program_) {
+    char* vert_str = read_string("../icast/demo/res/shader/vertex.vsh");
+    char* frag_str = read_string("../icast/demo/res/shader/convert_fragment.fsh");
+    convert_program_ = GLProgram::create_by_shader_string(vert_str, frag_str);
+    free(vert_str);
+    free(frag_str);
+    int error = glGetError();
+    if (error != GL_NO_ERROR) return -error;
+
+    GLuint program_id = convert_program_->get_id();
+    convert_vertices_handle_ = glGetAttribLocation(program_id, "model_coords");
+    convert_mvp_matrix_handle_ = glGetUniformLocation(program_id, "mvp_matrix");
+    convert_color_map_handle_ = glGetUniformLocation(program_id, "color_map");
+    convert_frame_size_handle_ = glGetUniformLocation(program_id, "frame_size");
+    convert_content_size_handle_ = glGetUniformLocation(program_id, "content_size");
+    convert_storage_size_handle_ = glGetUniformLocation(program_id, "storage_size");
+    convert_color_matrix_handle_ = glGetUniformLocation(program_id, "color_matrix");
+    convert_color_offset_handle_ = glGetUniformLocation(program_id, "color_offset");
+    convert_is_planar_handle_ = glGetUniformLocation(program_id, "is_planar");
+  }
+
+  // four bytes of a row per texel, luma rows then chroma rows
+  Texture::Attributes attr = *Texture::s_default_texture_attributes_;
+  attr.min_filter_ = GL_NEAREST;
+  attr.mag_filter_ = GL_NEAREST;
+  convert_texture_ = new Texture(width >> 2, height * 3 / 2, &attr);
+  glGenFramebuffers(1, &convert_frame_buffer_);
+  glBindFramebuffer(GL_FRAMEBUFFER, convert_frame_buffer_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         convert_texture_->get_texture(), 0);
+  GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    release_convert_pass();
+    return -1;
+  }
+  convert_width_ = width;
+  convert_height_ = height;
+  return 0;
+}
+
+void GLRenderer::release_convert_pass()
+{
+  if (convert_frame_buffer_) glDeleteFramebuffers(1, &convert_frame_buffer_);
+  convert_frame_buffer_ = 0;
+  if (convert_texture_) delete convert_texture_; // reads in flight are dropped
+  convert_texture_ = nullptr;
+  convert_width_ = 0;
+  convert_height_ = 0;
+}
+
+/**
+ * @brief GLRenderer::drain_converted_frames, wait for reads in flight and hand them out,
+ *        before the pass is set up again for another size or format
+ */
+void GLRenderer::drain_converted_frames()
+{
+  if (!convert_texture_ || !convert_callback_) return;
+  unsigned char* data = nullptr;
+  int length = 0;
+  while ((length = convert_texture_->download_pixels(data, true)) > 0) {
+    convert_callback_(data, length, convert_width_, convert_height_, convert_format_);
+  }
+}
+
+void GLRenderer::convert_frame()
+{
+  if (is_convert_changed_) {
+    drain_converted_frames();
+    release_convert_pass();
+    pthread_mutex_lock(&pixel_mutex_);
+    convert_callback_ = pending_convert_callback_;
+    convert_format_ = pending_convert_format_;
+    memcpy(convert_matrix_, pending_convert_matrix_, sizeof(convert_matrix_));
+    memcpy(convert_offset_, pending_convert_offset_, sizeof(convert_offset_));
+    is_convert_changed_ = false;
+    pthread_mutex_unlock(&pixel_mutex_);
+  }
+  if (!convert_callback_ || tex_format_ != PIXEL_FORMAT_RGBA || !input_texture_
+   || render_ctrl_->get_gl_version() < 3) {
+    return;
+  }
+
+  // luma texels take 4 pixels, I420 chroma rows are paired in a row of output
+  int align_width = convert_format_ == PIXEL_FORMAT_I420 ? 8 : 4;
+  int align_height = convert_format_ == PIXEL_FORMAT_I420 ? 4 : 2;
+  int width = (tex_width_ + align_width - 1) / align_width * align_width;
+  int height = (tex_height_ + align_height - 1) / align_height * align_height;
+  if (width != convert_width_ || height != convert_height_) {
+    drain_converted_frames();
+    release_convert_pass();
+    if (setup_convert_pass(width, height) < 0) {
+      convert_callback_ = nullptr; // not to fail again on every frame
+      return;
+    }
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, convert_frame_buffer_);
+  glViewport(0, 0, width >> 2, height * 3 / 2);
+  glUseProgram(convert_program_->get_id());
+  glEnableVertexAttribArray(convert_vertices_handle_);
+  glVertexAttribPointer(convert_vertices_handle_, 2, GL_FLOAT, 0, 0, VERTEX_COORDS);
+  glUniformMatrix4fv(convert_mvp_matrix_handle_, 1, GL_FALSE, IDENTITY_MATRIX);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, input_texture_->get_texture());
+  glUniform1i(convert_color_map_handle_, 0);
+  glUniform2f(convert_frame_size_handle_, (float) width, (float) height);
+  glUniform2f(convert_content_size_handle_, (float) tex_width_, (float) tex_height_);
+  glUniform2f(convert_storage_size_handle_,
+              (float) input_texture_->get_storage_width(), (float) input_texture_->get_height());
+  glUniformMatrix3fv(convert_color_matrix_handle_, 1, GL_FALSE, convert_matrix_);
+  glUniform3fv(convert_color_offset_handle_, 1, convert_offset_);
+  glUniform1f(convert_is_planar_handle_, convert_format_ == PIXEL_FORMAT_I420 ? 1.0f : 0.0f);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glDisableVertexAttribArray(convert_vertices_handle_);
+  glUseProgram(0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  unsigned char* data = nullptr;
+  int length = convert_texture_->download_pixels(data);
+  if (data) convert_callback_(data, length, width, height, convert_format_);
+}
+
 int GLRenderer::check_texture_size(int width, int height)
 {
   if (width == tex_width_ && height == tex_height_) {
@@ -281,46 +823,254 @@ int GLRenderer::check_texture_size(int width, int height)
   need_reset_pbo_ = true;
   tex_width_ = width;
   tex_height_ = height;
-  if (input_texture_) render_ctrl_->return_texture(input_texture_);
-  if (input_texture_uv_) render_ctrl_->return_texture(input_texture_uv_);
-  if (tex_format_ == PIXEL_FORMAT_RGBA) {
-    input_texture_ = render_ctrl_->fetch_texture(tex_width_, tex_height_);
-  } else { // YUYV
-    Texture::Attributes attr = *Texture::s_default_texture_attributes_;
-    attr.format_ = GL_LUMINANCE_ALPHA;
-    attr.internal_format_ = GL_LUMINANCE_ALPHA;
-    input_texture_ = render_ctrl_->fetch_texture(tex_width_, tex_height_, &attr);
-    input_texture_uv_ = render_ctrl_->fetch_texture(tex_width_ >> 1, tex_height_);
+  if (!input_texture_ || width > storage_width_ || height > storage_height_
+   || width * height * 4 < storage_width_ * storage_height_) {
+    // first size is taken as it is, a changing one gets room to change further,
+    // storage is given up only when the frame shrinks below a quarter of it
+    bool is_resizing = input_texture_ != nullptr;
+    storage_width_ = is_resizing ? bucket_size(width) : width;
+    storage_height_ = is_resizing ? bucket_size(height) : height;
+    return_input_textures();
+    fetch_input_textures();
+  }
+  int chroma_width = (tex_width_ + 1) >> 1;
+  int chroma_height = (tex_height_ + 1) >> 1;
+  if (tex_format_ == PIXEL_FORMAT_YUYV) {
+    input_texture_->set_content_size(tex_width_ >> 1, tex_height_);
+  } else {
+    input_texture_->set_content_size(tex_width_, tex_height_);
   }
+  if (input_texture_uv_) input_texture_uv_->set_content_size(chroma_width, chroma_height);
+  if (input_texture_v_) input_texture_v_->set_content_size(chroma_width, chroma_height);
+  reset_tex_coords();
   reset_mvp_matrix();
   return 1;
 }
 
+/**
+ * @brief GLRenderer::reset_tex_coords, map the quad onto the part of input textures holding the frame,
+ *        chroma planes are allocated at half of luma storage, so one mapping fits all planes
+ */
+void GLRenderer::reset_tex_coords()
+{
+  float scale_s = 1.0f;
+  float scale_t = 1.0f;
+  if (input_texture_) {
+    int width = input_texture_->get_content_width();
+    int height = input_texture_->get_content_height();
+    int storage_width = input_texture_->get_storage_width();
+    int storage_height = input_texture_->get_height();
+    // stop half a texel short, linear filtering must not blend in what lies beyond the frame
+    if (width < storage_width) scale_s = (width - 0.5f) / storage_width;
+    if (height < storage_height) scale_t = (height - 0.5f) / storage_height;
+  }
+  for (int i = 0; i < 8; i += 2) {
+    tex_coords_[i] = TEXTURE_COORDS[i] * scale_s;
+    tex_coords_[i + 1] = TEXTURE_COORDS[i + 1] * scale_t;
+  }
+}
+
 int GLRenderer::setup_pixel_buffer()
 {
-  if (!need_reset_pbo_ && pixel_buffer_object_) return 0;
-  if (pixel_buffer_object_) glDeleteBuffers(1, &pixel_buffer_object_);
+  if (!need_reset_pbo_ && pixel_buffer_objects_[0]) return 0;
+  release_pixel_buffer();
 
-  glGenBuffers(1, &pixel_buffer_object_);
-  glBindBuffer(GL_ARRAY_BUFFER, pixel_buffer_object_);
-  if (tex_format_ == PIXEL_FORMAT_RGBA) {
-    glBufferData(GL_ARRAY_BUFFER, tex_width_ * tex_height_ * 4, nullptr, GL_DYNAMIC_DRAW);
-  } else {
-    glBufferData(GL_ARRAY_BUFFER, tex_width_ * tex_height_ * 2, nullptr, GL_DYNAMIC_DRAW);
+  glGenBuffers(NUM_PIXEL_BUFFERS, pixel_buffer_objects_);
+  for (int i = 0; i < NUM_PIXEL_BUFFERS; i++) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer_objects_[i]);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, get_frame_size(), nullptr, GL_STREAM_DRAW);
   }
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  pixel_buffer_index_ = 0;
   need_reset_pbo_ = false;
 
   int error = glGetError();
   return -error;
 }
 
+void GLRenderer::release_pixel_buffer()
+{
+  for (int i = 0; i < NUM_PIXEL_BUFFERS; i++) {
+    if (pixel_buffer_fences_[i]) glDeleteSync(pixel_buffer_fences_[i]);
+    pixel_buffer_fences_[i] = 0;
+  }
+  if (pixel_buffer_objects_[0]) glDeleteBuffers(NUM_PIXEL_BUFFERS, pixel_buffer_objects_);
+  memset(pixel_buffer_objects_, 0, sizeof(pixel_buffer_objects_));
+}
+
+/**
+ * @brief GLRenderer::get_plane_layouts, where rows of each plane are in a frame with given stride
+ *        and where they go in a pbo, which holds planes tightly packed
+ * @param stride, bytes per row of the first plane, chroma rows of planar formats take half of it,
+ *        0 for tightly packed
+ * @return number of planes
+ */
+int GLRenderer::get_plane_layouts(int stride, PlaneLayout planes[3])
+{
+  int chroma_width = (tex_width_ + 1) >> 1;
+  int chroma_height = (tex_height_ + 1) >> 1;
+  int luma_stride = stride ? stride : tex_width_;
+  int chroma_stride = stride ? (stride + 1) >> 1 : chroma_width;
+  switch (tex_format_) {
+  case PIXEL_FORMAT_I420:
+    planes[0] = { 0, luma_stride, 0, tex_width_, tex_height_ };
+    planes[1] = { luma_stride * tex_height_, chroma_stride,
+                  tex_width_ * tex_height_, chroma_width, chroma_height };
+    planes[2] = { planes[1].src_offset_ + chroma_stride * chroma_height, chroma_stride,
+                  planes[1].dst_offset_ + chroma_width * chroma_height, chroma_width, chroma_height };
+    return 3;
+  case PIXEL_FORMAT_NV12:
+  case PIXEL_FORMAT_NV21:
+    planes[0] = { 0, luma_stride, 0, tex_width_, tex_height_ };
+    planes[1] = { luma_stride * tex_height_, chroma_stride * 2,
+                  tex_width_ * tex_height_, chroma_width * 2, chroma_height };
+    return 2;
+  case PIXEL_FORMAT_RGBA:
+    planes[0] = { 0, stride ? stride : tex_width_ * 4, 0, tex_width_ * 4, tex_height_ };
+    return 1;
+  case PIXEL_FORMAT_YUYV:
+    planes[0] = { 0, stride ? stride : tex_width_ * 2, 0, tex_width_ * 2, tex_height_ };
+    return 1;
+  case PIXEL_FORMAT_RGB:
+  case PIXEL_FORMAT_MJPEG:
+    break;
+  }
+  return 0;
+}
+
+/**
+ * @brief GLRenderer::fill_pixel_buffer, copy a frame into the current slot of the ring,
+ *        the mapping is unsynchronized so the copy never waits for uploads of other slots
+ * @param stride, bytes per row of the first plane, 0 for tightly packed
+ * @return pbo filled
+ */
+GLuint GLRenderer::fill_pixel_buffer(const uint8_t* pixels, int stride)
+{
+  GLuint pbo = pixel_buffer_objects_[pixel_buffer_index_];
+  uint8_t* dst = (uint8_t*) map_pixel_buffer();
+  PlaneLayout planes[3];
+  int num_planes = get_plane_layouts(stride, planes);
+  for (int i = 0; i < num_planes; i++) {
+    const PlaneLayout& plane = planes[i];
+    // padded rows (e.g. v4l2 buffers) go row by row
+    bool is_packed = plane.src_stride_ == plane.row_size_;
+    int rows = is_packed ? 1 : plane.rows_;
+    int copy_size = is_packed ? plane.row_size_ * plane.rows_ : plane.row_size_;
+    for (int row = 0; row < rows; row++) {
+      const uint8_t* src = pixels + plane.src_offset_ + row * plane.src_stride_;
+      int dst_offset = plane.dst_offset_ + row * plane.row_size_;
+      if (dst) {
+        memcpy(dst + dst_offset, src, copy_size);
+      } else {
+        glBufferSubData(GL_PIXEL_UNPACK_BUFFER, dst_offset, copy_size, src);
+      }
+    }
+  }
+  if (dst) glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  return pbo;
+}
+
+/**
+ * @brief GLRenderer::map_pixel_buffer, map the current slot of the ring for writing,
+ *        the mapping is unsynchronized so it never waits for uploads of other slots,
+ *        the slot is left bound to GL_PIXEL_UNPACK_BUFFER
+ */
+void* GLRenderer::map_pixel_buffer()
+{
+  GLsync& fence = pixel_buffer_fences_[pixel_buffer_index_];
+  if (fence) {
+    // normally signaled long ago, the slot was used NUM_PIXEL_BUFFERS frames before
+    glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    glDeleteSync(fence);
+    fence = 0;
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer_objects_[pixel_buffer_index_]);
+  return glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, get_frame_size(),
+                          GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+void GLRenderer::provide_mapped_buffer()
+{
+  pthread_mutex_lock(&pixel_mutex_);
+  if (!mapped_buffer_ && tex_width_ > 0 && tex_height_ > 0 && !is_pixel_updated
+   && is_pbo_supported()) {
+    setup_pixel_buffer();
+    mapped_buffer_ = (unsigned char *) map_pixel_buffer();
+    mapped_size_ = get_frame_size();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+  pthread_mutex_unlock(&pixel_mutex_);
+}
+
+void GLRenderer::release_mapped_buffer()
+{
+  if (!mapped_buffer_ || is_mapped_acquired_) return;
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer_objects_[pixel_buffer_index_]);
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  mapped_buffer_ = nullptr;
+}
+
+void GLRenderer::set_buffer_provided(bool is_provided)
+{
+  is_buffer_provided_ = is_provided;
+}
+
+unsigned char* GLRenderer::acquire_buffer(int length)
+{
+  unsigned char* buffer = nullptr;
+  pthread_mutex_lock(&pixel_mutex_);
+  if (mapped_buffer_ && !is_mapped_acquired_ && !is_mapped_committed_ && length == mapped_size_) {
+    is_mapped_acquired_ = true;
+    buffer = mapped_buffer_;
+  }
+  pthread_mutex_unlock(&pixel_mutex_);
+  return buffer;
+}
+
+void GLRenderer::commit_buffer(unsigned char* buffer, int length)
+{
+  pthread_mutex_lock(&pixel_mutex_);
+  if (buffer && buffer == mapped_buffer_ && is_mapped_acquired_) {
+    if (length > 0) {
+      committed_buffer_ = buffer;
+      is_mapped_committed_ = true;
+      pending_dmabuf_fd_ = -1;
+      is_pixel_updated = true;
+    } else {
+      is_mapped_acquired_ = false;
+    }
+  }
+  pthread_mutex_unlock(&pixel_mutex_);
+  if (length > 0) render_ctrl_->request_render();
+}
+
 int GLRenderer::setup_program()
 {
   char* vert_str = read_string("../icast/demo/res/shader/vertex.vsh");
-  char* frag_str = tex_format_ == PIXEL_FORMAT_RGBA
-        ? read_string("../icast/demo/res/shader/rgba_fragment.fsh")
-        : read_string("../icast/demo/res/shader/yuyv_fragment.fsh");
+  char* frag_str = nullptr;
+  switch (tex_format_) {
+  case PIXEL_FORMAT_RGBA:
+    frag_str = read_string("../icast/demo/res/shader/rgba_fragment.fsh");
+    break;
+  case PIXEL_FORMAT_I420:
+    frag_str = read_string("../icast/demo/res/shader/i420_fragment.fsh");
+    break;
+  case PIXEL_FORMAT_NV12:
+    frag_str = read_string("../icast/demo/res/shader/nv12_fragment.fsh");
+    break;
+  case PIXEL_FORMAT_NV21:
+    frag_str = read_string("../icast/demo/res/shader/nv21_fragment.fsh");
+    break;
+  case PIXEL_FORMAT_YUYV:
+    frag_str = read_string("../icast/demo/res/shader/yuyv_fragment.fsh");
+    break;
+  case PIXEL_FORMAT_RGB:
+  case PIXEL_FORMAT_MJPEG:
+    free(vert_str);
+    return -1; // see is_format_drawable
+  }
   program_ = GLProgram::create_by_shader_string(vert_str, frag_str);
   free(vert_str);
   free(frag_str);
@@ -335,20 +1085,84 @@ int GLRenderer::setup_program()
   mvp_matrix_handle_ = glGetUniformLocation(program_id, "mvp_matrix");
   color_map_handle_ = glGetUniformLocation(program_id, "color_map");
   uv_color_map_handle_ = glGetUniformLocation(program_id, "uv_color_map");
+  v_color_map_handle_ = glGetUniformLocation(program_id, "v_color_map");
+  tex_width_handle_ = glGetUniformLocation(program_id, "tex_width");
+  color_matrix_handle_ = glGetUniformLocation(program_id, "color_matrix");
+  color_offset_handle_ = glGetUniformLocation(program_id, "color_offset");
   vertices_handle_ = glGetAttribLocation(program_id, "model_coords");
   tex_coord_handle_ = glGetAttribLocation(program_id, "tex_coords");
   error = glGetError();
   if (error != GL_NO_ERROR) return -error;
 
-  if (tex_format_ == PIXEL_FORMAT_RGBA) {
-    input_texture_ = render_ctrl_->fetch_texture(tex_width_, tex_height_);
-  } else { // YUYV
-    Texture::Attributes attr = *Texture::s_default_texture_attributes_;
+  return_input_textures();
+  fetch_input_textures();
+  error = glGetError();
+  return -error;
+}
+
+void GLRenderer::fetch_input_textures()
+{
+  Texture::Attributes attr = *Texture::s_default_texture_attributes_;
+  int chroma_width = (storage_width_ + 1) >> 1;
+  int chroma_height = (storage_height_ + 1) >> 1;
+  switch (tex_format_) {
+  case PIXEL_FORMAT_RGBA:
+    input_texture_ = render_ctrl_->fetch_texture(storage_width_, storage_height_);
+    break;
+  case PIXEL_FORMAT_I420:
+    attr.format_ = GL_LUMINANCE;
+    attr.internal_format_ = GL_LUMINANCE;
+    input_texture_ = render_ctrl_->fetch_texture(storage_width_, storage_height_, &attr);
+    input_texture_uv_ = render_ctrl_->fetch_texture(chroma_width, chroma_height, &attr);
+    input_texture_v_ = render_ctrl_->fetch_texture(chroma_width, chroma_height, &attr);
+    break;
+  case PIXEL_FORMAT_NV12:
+  case PIXEL_FORMAT_NV21:
+    attr.format_ = GL_LUMINANCE;
+    attr.internal_format_ = GL_LUMINANCE;
+    input_texture_ = render_ctrl_->fetch_texture(storage_width_, storage_height_, &attr);
     attr.format_ = GL_LUMINANCE_ALPHA;
     attr.internal_format_ = GL_LUMINANCE_ALPHA;
-    input_texture_ = render_ctrl_->fetch_texture(tex_width_, tex_height_, &attr);
-    input_texture_uv_ = render_ctrl_->fetch_texture(tex_width_ >> 1, tex_height_);
+    input_texture_uv_ = render_ctrl_->fetch_texture(chroma_width, chroma_height, &attr);
+    break;
+  case PIXEL_FORMAT_YUYV:
+    attr = get_yuyv_attributes();
+    input_texture_ = render_ctrl_->fetch_texture(storage_width_ >> 1, storage_height_, &attr);
+    break;
+  case PIXEL_FORMAT_RGB:
+  case PIXEL_FORMAT_MJPEG:
+    break;
   }
-  error = glGetError();
-  return -error;
+}
+
+void GLRenderer::return_input_textures()
+{
+  if (input_texture_) render_ctrl_->return_texture(input_texture_);
+  if (input_texture_uv_) render_ctrl_->return_texture(input_texture_uv_);
+  if (input_texture_v_) render_ctrl_->return_texture(input_texture_v_);
+  input_texture_ = nullptr;
+  input_texture_uv_ = nullptr;
+  input_texture_v_ = nullptr;
+}
+
+/**
+ * @brief GLRenderer::get_frame_size, bytes of a tightly packed frame in current format
+ */
+int GLRenderer::get_frame_size()
+{
+  int chroma_size = ((tex_width_ + 1) >> 1) * ((tex_height_ + 1) >> 1);
+  switch (tex_format_) {
+  case PIXEL_FORMAT_RGBA:
+    return tex_width_ * tex_height_ * 4;
+  case PIXEL_FORMAT_I420:
+  case PIXEL_FORMAT_NV12:
+  case PIXEL_FORMAT_NV21:
+    return tex_width_ * tex_height_ + chroma_size * 2;
+  case PIXEL_FORMAT_YUYV:
+    return tex_width_ * tex_height_ * 2;
+  case PIXEL_FORMAT_RGB:
+  case PIXEL_FORMAT_MJPEG:
+    break;
+  }
+  return 0;
 }
@@ -0,0 +1,273 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Andy Young
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "mjpeg_decoder.h"
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+
+struct JpegErrorMgr {
+  struct jpeg_error_mgr pub_;
+  jmp_buf jump_;
+};
+
+static void on_jpeg_error(j_common_ptr cinfo)
+{
+  longjmp(((JpegErrorMgr *) cinfo->err)->jump_, 1);
+}
+
+static void on_jpeg_message(j_common_ptr)
+{
+  // truncated frames are usual for usb cameras, keep quiet
+}
+
+/**
+ * @brief is_sampling_supported, luma subsampled horizontally by 2 (4:2:0 or 4:2:2),
+ *        which covers what usb cameras send
+ */
+static bool is_sampling_supported(j_decompress_ptr cinfo)
+{
+  if (cinfo->num_components != 3 || cinfo->jpeg_color_space != JCS_YCbCr) return false;
+  jpeg_component_info* comp = cinfo->comp_info;
+  return comp[0].h_samp_factor == 2 && (comp[0].v_samp_factor == 1 || comp[0].v_samp_factor == 2)
+      && comp[1].h_samp_factor == 1 && comp[1].v_samp_factor == 1
+      && comp[2].h_samp_factor == 1 && comp[2].v_samp_factor == 1;
+}
+
+MjpegDecoder::MjpegDecoder()
+{
+
+}
+
+MjpegDecoder::~MjpegDecoder()
+{
+  stop_worker();
+  std::unique_lock<std::mutex> lock(pool_mutex_);
+  for (unsigned char* buffer : free_buffers_) delete[] buffer;
+  free_buffers_.clear();
+}
+
+unsigned char* MjpegDecoder::acquire_buffer(size_t size)
+{
+  std::unique_lock<std::mutex> lock(pool_mutex_);
+  if (size != buffer_size_) {
+    for (unsigned char* buffer : free_buffers_) delete[] buffer;
+    free_buffers_.clear();
+    buffer_size_ = size;
+  }
+  if (free_buffers_.empty()) return new unsigned char[size];
+  unsigned char* buffer = free_buffers_.back();
+  free_buffers_.pop_back();
+  return buffer;
+}
+
+void MjpegDecoder::recycle(DecodedFrame& frame)
+{
+  if (!frame.data_) return;
+  std::unique_lock<std::mutex> lock(pool_mutex_);
+  if ((size_t) frame.length_ == buffer_size_) {
+    free_buffers_.push_back(frame.data_);
+  } else {
+    delete[] frame.data_; // size changed since it was acquired
+  }
+  frame.data_ = nullptr;
+  frame.length_ = 0;
+}
+
+int MjpegDecoder::decode(const unsigned char* src, int length, DecodedFrame& frame)
+{
+  std::unique_lock<std::mutex> lock(decode_mutex_);
+  return decode_internal(src, length, frame);
+}
+
+/**
+ * @brief MjpegDecoder::decode_internal, rows are decoded straight into the output planes
+ *        when their padded width matches, only 4:2:2 chroma and padded rows go through scratch_
+ */
+int MjpegDecoder::decode_internal(const unsigned char* src, int length, DecodedFrame& frame)
+{
+  struct jpeg_decompress_struct cinfo;
+  JpegErrorMgr err;
+  unsigned char* volatile out = nullptr;
+  size_t volatile out_size = 0;
+
+  cinfo.err = jpeg_std_error(&err.pub_);
+  err.pub_.error_exit = on_jpeg_error;
+  err.pub_.output_message = on_jpeg_message;
+  if (setjmp(err.jump_)) {
+    jpeg_destroy_decompress(&cinfo);
+    frame.data_ = out;
+    frame.length_ = (int) out_size;
+    recycle(frame);
+    frame.length_ = -1;
+    return -1;
+  }
+  jpeg_create_decompress(&cinfo);
+  // missing huffman tables (usual in MJPEG) are filled with the standard ones by libjpeg-turbo
+  jpeg_mem_src(&cinfo, (unsigned char *) src, (unsigned long) length);
+  jpeg_read_header(&cinfo, TRUE);
+  if (!is_sampling_supported(&cinfo)) {
+    jpeg_destroy_decompress(&cinfo);
+    frame.length_ = -1;
+    return -1;
+  }
+  cinfo.out_color_space = JCS_YCbCr;
+  cinfo.raw_data_out = TRUE;
+  cinfo.do_fancy_upsampling = FALSE;
+  cinfo.dct_method = JDCT_IFAST;
+  jpeg_start_decompress(&cinfo);
+
+  int width = (int) cinfo.output_width;
+  int height = (int) cinfo.output_height;
+  int chroma_width = (width + 1) / 2;
+  int chroma_height = (height + 1) / 2;
+  int pad_width = (int) cinfo.comp_info[0].width_in_blocks * DCTSIZE;
+  int pad_chroma_width = (int) cinfo.comp_info[1].width_in_blocks * DCTSIZE;
+  int luma_rows = cinfo.comp_info[0].v_samp_factor * DCTSIZE;
+  int chroma_rows = DCTSIZE;
+  int v_ratio = cinfo.comp_info[0].v_samp_factor; // luma rows per jpeg chroma row
+  bool is_luma_direct = pad_width == width;
+  bool is_chroma_direct = pad_chroma_width == chroma_width && v_ratio == 2;
+
+  out_size = (size_t) width * height + (size_t) chroma_width * chroma_height * 2;
+  out = acquire_buffer(out_size);
+  unsigned char* planes[3] = { out, out + width * height, out + width * height + chroma_width * chroma_height };
+  scratch_.resize((size_t) pad_width * luma_rows + (size_t) pad_chroma_width * chroma_rows * 2);
+  unsigned char* scratch[3] = { scratch_.data(), scratch_.data() + pad_width * luma_rows,
+                                scratch_.data() + pad_width * luma_rows + pad_chroma_width * chroma_rows };
+
+  JSAMPROW rows[3][2 * DCTSIZE];
+  JSAMPARRAY arrays[3] = { rows[0], rows[1], rows[2] };
+  while (cinfo.output_scanline < cinfo.output_height) {
+    int top = (int) cinfo.output_scanline;
+    for (int i = 0; i < luma_rows; i++) {
+      bool is_direct = is_luma_direct && top + i < height;
+      rows[0][i] = is_direct ? planes[0] + (top + i) * width : scratch[0] + i * pad_width;
+    }
+    for (int c = 1; c < 3; c++) {
+      for (int i = 0; i < chroma_rows; i++) {
+        bool is_direct = is_chroma_direct && top / 2 + i < chroma_height;
+        rows[c][i] = is_direct ? planes[c] + (top / 2 + i) * chroma_width : scratch[c] + i * pad_chroma_width;
+      }
+    }
+    jpeg_read_raw_data(&cinfo, arrays, luma_rows);
+
+    if (!is_luma_direct) {
+      for (int i = 0; i < luma_rows && top + i < height; i++) {
+        memcpy(planes[0] + (top + i) * width, rows[0][i], width);
+      }
+    }
+    if (!is_chroma_direct) {
+      for (int c = 1; c < 3; c++) {
+        for (int i = 0; i < chroma_rows; i++) {
+          int row = top / v_ratio + i; // in jpeg chroma rows
+          if (v_ratio == 1 && (row & 1)) continue; // 4:2:2, every other row is dropped
+          int dst_row = v_ratio == 1 ? row / 2 : row;
+          if (dst_row >= chroma_height) break;
+          memcpy(planes[c] + dst_row * chroma_width, rows[c][i], chroma_width);
+        }
+      }
+    }
+  }
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+
+  frame.data_ = out;
+  frame.length_ = (int) out_size;
+  frame.width_ = width;
+  frame.height_ = height;
+  return frame.length_;
+}
+
+void MjpegDecoder::start_worker()
+{
+  if (is_running_) return;
+  is_running_ = true;
+  pthread_create(&work_thread_, nullptr, work_loop, this);
+}
+
+void MjpegDecoder::stop_worker()
+{
+  if (!is_running_) return;
+  {
+    std::unique_lock<std::mutex> lock(work_mutex_);
+    is_running_ = false;
+    cv_.notify_all();
+  }
+  pthread_join(work_thread_, nullptr);
+  has_pending_ = false;
+  if (has_result_) recycle(result_);
+  has_result_ = false;
+}
+
+bool MjpegDecoder::submit(const unsigned char* src, int length, int tag)
+{
+  std::unique_lock<std::mutex> lock(work_mutex_);
+  if (!is_running_ || has_pending_ || has_result_) return false;
+  pending_src_ = src;
+  pending_length_ = length;
+  pending_tag_ = tag;
+  has_pending_ = true;
+  cv_.notify_all();
+  return true;
+}
+
+bool MjpegDecoder::fetch(DecodedFrame& frame)
+{
+  std::unique_lock<std::mutex> lock(work_mutex_);
+  if (!has_result_) return false;
+  frame = result_;
+  result_ = DecodedFrame();
+  has_result_ = false;
+  return true;
+}
+
+bool MjpegDecoder::is_busy()
+{
+  std::unique_lock<std::mutex> lock(work_mutex_);
+  return has_pending_ || has_result_;
+}
+
+void* MjpegDecoder::work_loop(void* data)
+{
+  MjpegDecoder* decoder = (MjpegDecoder *)data;
+  std::unique_lock<std::mutex> lock(decoder->work_mutex_);
+  while (decoder->is_running_) {
+    if (!decoder->has_pending_ || decoder->has_result_) {
+      decoder->cv_.wait(lock);
+      continue;
+    }
+    const unsigned char* src = decoder->pending_src_;
+    int length = decoder->pending_length_;
+    DecodedFrame frame;
+    frame.tag_ = decoder->pending_tag_;
+    lock.unlock();
+    decoder->decode(src, length, frame);
+    lock.lock();
+    decoder->result_ = frame;
+    decoder->has_result_ = true;
+    decoder->has_pending_ = false;
+  }
+  return nullptr;
+}
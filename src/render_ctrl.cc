@@ -23,17 +23,18 @@
  */
 #include "render_ctrl.h"
 #include "gl_renderer.h"
-#include <sys/time.h>
-#include <unistd.h>
 
 static const int RENDERER_STATE_IDLE = 1;
 static const int RENDERER_STATE_READY = 2;
 static const int RENDERER_STATE_RELEASE = 3;
 static const int RENDERER_STATE_DEAD = 4;
 
-RenderCtrl::RenderCtrl() : texture_cache_(), renderer_list_()
-{
+static const size_t DEFAULT_TEXTURE_BUDGET = 128 * 1024 * 1024;
 
+RenderCtrl::RenderCtrl() : texture_cache_(), renderer_list_(), is_render_requested_(false)
+{
+  // textures are returned by capture threads too, gl objects are deleted in render thread only
+  texture_cache_.set_budget(DEFAULT_TEXTURE_BUDGET, false);
 }
 
 RenderCtrl::~RenderCtrl()
@@ -55,6 +56,9 @@ void RenderCtrl::stop()
 {
   if (!is_running_) return;
   is_running_ = false;
+  wake_mutex_.lock();
+  wake_mutex_.unlock();
+  wake_cv_.notify_all();
   pthread_join(render_thread_, nullptr);
 }
 
@@ -64,6 +68,51 @@ void RenderCtrl::set_fps(float fps)
   interval_us_ = (int) (1000000 / fps);
 }
 
+void RenderCtrl::set_fps(GLRenderer* renderer, float fps)
+{
+  std::unique_lock<std::mutex> lock(render_mutex_);
+  int interval_us = fps > 0.0001 ? (int) (1000000 / fps) : 0;
+  Schedule& schedule = renderer_schedules_[renderer];
+  if (schedule.interval_us_ == interval_us) return;
+  schedule.interval_us_ = interval_us;
+  auto iter = renderer_list_.find(renderer);
+  if (iter != renderer_list_.end() && iter->second == RENDERER_STATE_READY) {
+    schedule_renderer(renderer, std::chrono::steady_clock::now()); // new rate takes effect now
+  }
+}
+
+void RenderCtrl::set_render_mode(RenderMode mode)
+{
+  render_mode_ = mode;
+  request_render();
+}
+
+void RenderCtrl::request_render()
+{
+  if (is_render_requested_.exchange(true)) return; // render thread has not picked the last one yet
+  // waiter checks the flag under the lock, so it can not miss it between checking and sleeping
+  wake_mutex_.lock();
+  wake_mutex_.unlock();
+  wake_cv_.notify_one();
+}
+
+/**
+ * @brief RenderCtrl::wait_for_render
+ * @param next_time, when the earliest renderer is due
+ * @param serve_until, in on-frame mode, renderers due before it are visited without waiting for a request
+ * @return true if a request has been taken
+ */
+bool RenderCtrl::wait_for_render(const TimePoint& next_time, const TimePoint& serve_until)
+{
+  std::unique_lock<std::mutex> lock(wake_mutex_);
+  if (render_mode_ == RENDER_MODE_ON_FRAME && next_time > serve_until) {
+    wake_cv_.wait(lock, [&] { return is_render_requested_ || !is_running_ || render_mode_ != RENDER_MODE_ON_FRAME; });
+  }
+  // requests coming during the wait are served by one pass
+  wake_cv_.wait_until(lock, next_time, [&] { return !is_running_; });
+  return is_render_requested_.exchange(false);
+}
+
 EGLSurface RenderCtrl::create_surface(void* window) {
   return egl_core_->create_window_surface(window);
 }
@@ -76,12 +125,14 @@ void RenderCtrl::setup_egl()
 {
   if (egl_core_) return;
 
-  egl_core_ = new EglCore();
+  egl_core_ = new EglCore(EGL_NO_CONTEXT, FLAG_TRY_GLES3);
   cur_background_surface_ = egl_core_->create_offscreen_surface(1, 1);
   egl_core_->make_current(cur_background_surface_);
+  is_dmabuf_supported_ = egl_core_->has_extension("EGL_EXT_image_dma_buf_import");
 }
 
 void RenderCtrl::release_egl() {
+  is_dmabuf_supported_ = false;
   if (egl_core_) {
     if (cur_background_surface_) egl_core_->release_surface(cur_background_surface_);
     cur_background_surface_ = 0;
@@ -96,20 +147,19 @@ void* RenderCtrl::render_loop(void* data)
 
   renderer->setup_egl();
 
-  timeval tmp_time;
-  long start = 0;
-  long end = renderer->interval_us_;
+  // monotonic, not to be fooled by adjustment of wall clock
+  TimePoint next_time = std::chrono::steady_clock::now();
+  TimePoint serve_until = next_time;
   while (renderer->is_running_) {
-    usleep(std::max(0L, renderer->interval_us_ - (end - start)));
+    if (renderer->wait_for_render(next_time, serve_until)) {
+      // whoever requested may not be due yet, keep going until every renderer had its turn
+      serve_until = renderer->get_last_due_time();
+    }
     if (!renderer->is_running_) break;
 
-    gettimeofday(&tmp_time, nullptr);
-    start = tmp_time.tv_sec * 1000000 + tmp_time.tv_usec;
     renderer->setup_renderers();
-    renderer->do_rendering();
+    next_time = renderer->do_rendering();
     renderer->release_renderers();
-    gettimeofday(&tmp_time, nullptr);
-    end = tmp_time.tv_sec * 1000000 + tmp_time.tv_usec;
   }
 
   renderer->release_renderers();
@@ -131,19 +181,36 @@ void RenderCtrl::make_current(EGLSurface &surface)
   }
 }
 
+void* RenderCtrl::create_dmabuf_image(int fd, int width, int height, int fourcc, int pitch)
+{
+  if (!egl_core_) return nullptr;
+  EGLImageKHR image = egl_core_->create_dmabuf_image(fd, width, height, fourcc, 0, pitch);
+  return image == EGL_NO_IMAGE_KHR ? nullptr : image;
+}
+
+void RenderCtrl::release_image(void* image)
+{
+  if (egl_core_ && image) egl_core_->release_image(image);
+}
+
+int RenderCtrl::get_gl_version()
+{
+  return egl_core_ ? egl_core_->get_gl_version() : -1;
+}
+
 void RenderCtrl::add_renderer(GLRenderer *renderer)
 {
   std::unique_lock<std::mutex> lock(render_mutex_);
   if (renderer_list_.find(renderer) == renderer_list_.end()) {
     renderer_list_[renderer] = RENDERER_STATE_IDLE;
-    return;
-  }
-  int state = renderer_list_[renderer];
-  if (state == RENDERER_STATE_DEAD) {
+  } else if (renderer_list_[renderer] == RENDERER_STATE_DEAD) {
     renderer_list_[renderer] = RENDERER_STATE_IDLE;
-  } else if (state == RENDERER_STATE_RELEASE) {
+  } else if (renderer_list_[renderer] == RENDERER_STATE_RELEASE) {
     renderer_list_[renderer] = RENDERER_STATE_READY;
+    schedule_renderer(renderer, std::chrono::steady_clock::now());
   }
+  lock.unlock();
+  request_render();
 }
 
 void RenderCtrl::remove_renderer(GLRenderer *renderer)
@@ -159,6 +226,7 @@ void RenderCtrl::remove_renderer(GLRenderer *renderer)
     renderer_list_[renderer] = RENDERER_STATE_RELEASE;
     is_done_release_ = false;
   }
+  request_render();
   cv_.wait(lock, [&] { return is_done_release_; });
 }
 
@@ -174,17 +242,55 @@ void RenderCtrl::clear_renderers()
     renderer_list_[item.first] = RENDERER_STATE_RELEASE;
     is_done_release_ = false;
   }
+  request_render();
   cv_.wait(lock, [&] { return is_done_release_; });
 }
 
-void RenderCtrl::do_rendering()
+/**
+ * @brief RenderCtrl::do_rendering, draw renderers which are due
+ * @return when the next renderer is due
+ */
+RenderCtrl::TimePoint RenderCtrl::do_rendering()
 {
   std::unique_lock<std::mutex> lock(render_mutex_);
+  TimePoint now = std::chrono::steady_clock::now();
+  while (!due_queue_.empty() && due_queue_.top().first <= now) {
+    DueEntry entry = due_queue_.top();
+    due_queue_.pop();
+    auto iter = renderer_list_.find(entry.second);
+    Schedule& schedule = renderer_schedules_[entry.second];
+    if (iter == renderer_list_.end() || iter->second != RENDERER_STATE_READY
+     || schedule.due_time_ != entry.first) {
+      continue; // renderer gone or rescheduled
+    }
+    entry.second->draw();
+
+    std::chrono::microseconds interval(schedule.interval_us_ > 0 ? schedule.interval_us_ : interval_us_);
+    TimePoint due_time = entry.first + interval;
+    if (due_time <= now) due_time = now + interval; // fell behind, do not catch up with a burst
+    schedule_renderer(entry.second, due_time);
+  }
+  texture_cache_.trim_to_budget();
+  if (due_queue_.empty()) return now + std::chrono::microseconds(interval_us_);
+  return due_queue_.top().first;
+}
+
+void RenderCtrl::schedule_renderer(GLRenderer* renderer, const TimePoint& due_time)
+{
+  renderer_schedules_[renderer].due_time_ = due_time;
+  due_queue_.push(DueEntry(due_time, renderer));
+}
+
+RenderCtrl::TimePoint RenderCtrl::get_last_due_time()
+{
+  std::unique_lock<std::mutex> lock(render_mutex_);
+  TimePoint last_time = std::chrono::steady_clock::now();
   for (auto renderer : renderer_list_) {
     if (renderer.second == RENDERER_STATE_READY) {
-      renderer.first->draw();
+      last_time = std::max(last_time, renderer_schedules_[renderer.first].due_time_);
     }
   }
+  return last_time;
 }
 
 void RenderCtrl::setup_renderers()
@@ -194,6 +300,7 @@ void RenderCtrl::setup_renderers()
     if (renderer.second == RENDERER_STATE_IDLE
      && renderer.first->setup() >= 0) {
       renderer_list_[renderer.first] = RENDERER_STATE_READY;
+      schedule_renderer(renderer.first, std::chrono::steady_clock::now());
     }
   }
 }
@@ -214,10 +321,22 @@ void RenderCtrl::release_renderers()
 
 Texture* RenderCtrl::fetch_texture(int width, int height, Cacheable::Attributes *attribute)
 {
-  return texture_cache_.fetch_object(width, height, (Texture::Attributes *)attribute);
+  Texture* texture = texture_cache_.fetch_object(width, height, (Texture::Attributes *)attribute);
+  texture->set_content_size(width, height); // may be left smaller by its last user
+  return texture;
 }
 
 void RenderCtrl::return_texture(Texture *texture)
 {
   texture_cache_.return_object(texture);
 }
+
+void RenderCtrl::set_texture_budget(size_t bytes)
+{
+  texture_cache_.set_budget(bytes, false);
+}
+
+ObjectCacher<Texture, Texture::Attributes>::Stats RenderCtrl::get_texture_stats()
+{
+  return texture_cache_.get_stats();
+}
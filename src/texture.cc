@@ -24,13 +24,21 @@
 #include "texture.h"
 #include <cassert>
 #include <cstring>
+#include <EGL/egl.h>
+#include <GLES2/gl2ext.h>
 
 static const int GL_WIDTH_ALIGN_SIZE = 2;
+static const GLuint64 PACK_WAIT_TIMEOUT_NS = 100000000;
 
 static int gl_width(int width) {
   return (width + GL_WIDTH_ALIGN_SIZE - 1) / GL_WIDTH_ALIGN_SIZE * GL_WIDTH_ALIGN_SIZE;
 }
 
+static bool is_gles3() {
+  const char* version = (const char*) glGetString(GL_VERSION);
+  return version && strncmp(version, "OpenGL ES ", 10) == 0 && version[10] >= '3';
+}
+
 Texture::Attributes* Texture::s_default_texture_attributes_ = new Texture::Attributes();
 
 Texture* Texture::create(int width, int height, Cacheable::Attributes* attribute) {
@@ -42,10 +50,14 @@ Texture::Texture(int width, int height, Attributes* texture_attributes)
 :attributes_(*texture_attributes), texture_(0) {
   width_ = width;
   height_ = height;
+  content_width_ = width;
+  content_height_ = height;
+  upload_format_ = attributes_.format_;
   pixel_buffer_ = nullptr;
 }
 
 Texture::~Texture() {
+  finish_download();
   destroy_texture();
   texture_ = 0;
 
@@ -57,17 +69,73 @@ Texture::~Texture() {
   }
 }
 
-void Texture::upload_pixel_from_pbo(int pbo)
+int Texture::get_storage_width() const
+{
+  return gl_width(width_);
+}
+
+size_t Texture::get_byte_size() const
+{
+  int bytes_per_pixel = 4;
+  switch (attributes_.internal_format_) {
+  case GL_LUMINANCE:
+  case GL_ALPHA:
+  case GL_R8:
+    bytes_per_pixel = 1;
+    break;
+  case GL_LUMINANCE_ALPHA:
+  case GL_RG8:
+    bytes_per_pixel = 2;
+    break;
+  case GL_RGB:
+  case GL_RGB8:
+    bytes_per_pixel = 3;
+    break;
+  default:
+    break;
+  }
+  return (size_t) gl_width(width_) * height_ * bytes_per_pixel;
+}
+
+void Texture::upload_pixel_from_pbo(int pbo, size_t offset)
 {
   if (texture_ == 0) generate_texture();
   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
   glBindTexture(attributes_.target_, texture_);
-  glTexSubImage2D(attributes_.target_, 0, 0, 0, width_, height_,
-                  attributes_.format_, attributes_.type_, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rows of chroma planes are not 4-byte aligned
+  glTexSubImage2D(attributes_.target_, 0, 0, 0, content_width_, content_height_,
+                  upload_format_, attributes_.type_, (const void *) offset);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
   glBindTexture(attributes_.target_, 0);
   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 }
 
+void Texture::upload_pixels(const unsigned char* pixels)
+{
+  if (texture_ == 0) generate_texture();
+  glBindTexture(attributes_.target_, texture_);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(attributes_.target_, 0, 0, 0, content_width_, content_height_,
+                  upload_format_, attributes_.type_, pixels);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindTexture(attributes_.target_, 0);
+}
+
+void Texture::upload_sub_pixels(const unsigned char* pixels, int x, int y, int width, int height, int row_length)
+{
+  if (texture_ == 0) generate_texture();
+  glBindTexture(attributes_.target_, texture_);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, row_length);
+  glPixelStorei(GL_UNPACK_SKIP_PIXELS, x);
+  glPixelStorei(GL_UNPACK_SKIP_ROWS, y);
+  glTexSubImage2D(attributes_.target_, 0, x, y, width, height,
+                  upload_format_, attributes_.type_, pixels);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+  glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+  glBindTexture(attributes_.target_, 0);
+}
+
 void Texture::upload_pixel_from_buffer(unsigned char *pixel_buffer) {
   if (!pixel_buffer) {
     return;
@@ -77,17 +145,17 @@ void Texture::upload_pixel_from_buffer(unsigned char *pixel_buffer) {
   int length = 0;
   switch(attributes_.format_) {
   case GL_RGBA:
-    length = width_ * height_ * 4;
+    length = content_width_ * content_height_ * 4;
     break;
   case GL_LUMINANCE:
   case GL_ALPHA:
-    length = width_ * height_;
+    length = content_width_ * content_height_;
     break;
   case GL_LUMINANCE_ALPHA:
-    length = width_ * height_ * 2;
+    length = content_width_ * content_height_ * 2;
     break;
   default:
-    length = width_ * height_ * 4;
+    length = content_width_ * content_height_ * 4;
     break;
   }
   if (pixel_buffer_) {
@@ -98,14 +166,125 @@ void Texture::upload_pixel_from_buffer(unsigned char *pixel_buffer) {
   pixel_lock_.unlock();
 }
 
-void Texture::generate_texture() {
+int Texture::download_pixels(unsigned char* &pixel_buffer, bool is_flush)
+{
+  pixel_buffer = nullptr;
+  if (mapped_pack_ >= 0) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pack_buffers_[mapped_pack_]);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    mapped_pack_ = -1;
+  }
+  if (is_flush) return map_oldest_pack_buffer(pixel_buffer, true);
+
+  if (pack_count_ < NUM_PACK_BUFFERS) { // the gpu may have timed out the last wait
+    int res = read_into_pack_buffer();
+    if (res < 0) return res;
+  }
+  // with every slot in flight the next read would have none, wait for the oldest then
+  return map_oldest_pack_buffer(pixel_buffer, pack_count_ == NUM_PACK_BUFFERS);
+}
+
+void Texture::finish_download()
+{
+  if (mapped_pack_ >= 0) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pack_buffers_[mapped_pack_]);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    mapped_pack_ = -1;
+  }
+  for (int i = 0; i < NUM_PACK_BUFFERS; i++) {
+    if (pack_fences_[i]) glDeleteSync(pack_fences_[i]);
+    pack_fences_[i] = 0;
+    pack_capacities_[i] = 0;
+    pack_lengths_[i] = 0;
+  }
+  if (pack_buffers_[0]) glDeleteBuffers(NUM_PACK_BUFFERS, pack_buffers_);
+  memset(pack_buffers_, 0, sizeof(pack_buffers_));
+  if (frame_buffer_) glDeleteFramebuffers(1, &frame_buffer_);
+  frame_buffer_ = 0;
+  pack_index_ = 0;
+  pack_count_ = 0;
+}
+
+int Texture::read_into_pack_buffer()
+{
+  GLuint texture = get_texture();
+  if (!frame_buffer_) glGenFramebuffers(1, &frame_buffer_);
+  if (!pack_buffers_[0]) glGenBuffers(NUM_PACK_BUFFERS, pack_buffers_);
+
+  GLint last_frame_buffer = 0;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &last_frame_buffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, attributes_.target_, texture, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    glBindFramebuffer(GL_FRAMEBUFFER, last_frame_buffer);
+    return -1;
+  }
+
+  int length = content_width_ * content_height_ * 4;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pack_buffers_[pack_index_]);
+  if (pack_capacities_[pack_index_] < length) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, length, nullptr, GL_STREAM_READ);
+    pack_capacities_[pack_index_] = length;
+  }
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  // rgba is the one format every implementation reads, whatever the texture holds
+  glReadPixels(0, 0, content_width_, content_height_, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, last_frame_buffer);
+
+  if (pack_fences_[pack_index_]) glDeleteSync(pack_fences_[pack_index_]);
+  pack_fences_[pack_index_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glFlush(); // fence has to reach the gpu, or polling it never succeeds
+  pack_lengths_[pack_index_] = length;
+  pack_index_ = (pack_index_ + 1) % NUM_PACK_BUFFERS;
+  pack_count_++;
+  return 0;
+}
+
+int Texture::map_oldest_pack_buffer(unsigned char* &pixel_buffer, bool is_wait)
+{
+  if (pack_count_ == 0) return 0;
+  int slot = (pack_index_ - pack_count_ + NUM_PACK_BUFFERS) % NUM_PACK_BUFFERS;
+  GLenum status = glClientWaitSync(pack_fences_[slot], 0, is_wait ? PACK_WAIT_TIMEOUT_NS : 0);
+  if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return 0;
+
+  glDeleteSync(pack_fences_[slot]);
+  pack_fences_[slot] = 0;
+  pack_count_--;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pack_buffers_[slot]);
+  pixel_buffer = (unsigned char*) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pack_lengths_[slot], GL_MAP_READ_BIT);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  if (!pixel_buffer) return 0;
+  mapped_pack_ = slot;
+  return pack_lengths_[slot];
+}
+
+bool Texture::attach_egl_image(void* egl_image) {
+  static PFNGLEGLIMAGETARGETTEXTURE2DOESPROC image_target_texture =
+      (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC) eglGetProcAddress("glEGLImageTargetTexture2DOES");
+  if (!image_target_texture || !egl_image) return false;
+
+  destroy_texture();
+  generate_texture(false);
+  glBindTexture(attributes_.target_, texture_);
+  image_target_texture(attributes_.target_, (GLeglImageOES) egl_image);
+  glBindTexture(attributes_.target_, 0);
+  is_image_attached_ = true;
+  return glGetError() == GL_NO_ERROR;
+}
+
+void Texture::generate_texture(bool is_allocate) {
   glGenTextures(1, &texture_);
   glBindTexture(attributes_.target_, texture_);
   glTexParameteri(attributes_.target_, GL_TEXTURE_MIN_FILTER, attributes_.min_filter_);
   glTexParameteri(attributes_.target_, GL_TEXTURE_MAG_FILTER, attributes_.mag_filter_);
   glTexParameteri(attributes_.target_, GL_TEXTURE_WRAP_S, attributes_.wrap_s_);
   glTexParameteri(attributes_.target_, GL_TEXTURE_WRAP_T, attributes_.wrap_t_);
-  if (attributes_.target_ == GL_TEXTURE_2D) { // oes texture should be managed by the SF-service
+  if (is_allocate && attributes_.target_ == GL_TEXTURE_2D // oes texture should be managed by the SF-service
+   && !allocate_storage()) {
+    upload_format_ = attributes_.format_;
     glTexImage2D(attributes_.target_, 0, attributes_.internal_format_, gl_width(width_), height_,
                  0, attributes_.format_, attributes_.type_, 0);
   }
@@ -114,6 +293,57 @@ void Texture::generate_texture() {
   has_gen_tex_ = true;
 }
 
+/**
+ * @brief Texture::allocate_storage, immutable storage on GLES3, drivers skip the
+ *        completeness and reallocation checks of glTexImage2D on every use,
+ *        luminance has no sized format there, it is stored as red (green) and swizzled back
+ * @return false if the format has no immutable counterpart, texture is to be allocated the old way
+ */
+bool Texture::allocate_storage() {
+  static const bool s_is_gles3 = is_gles3();
+  if (!s_is_gles3 || attributes_.type_ != GL_UNSIGNED_BYTE) return false;
+
+  GLenum sized_format = 0;
+  GLint swizzle[4] = {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA};
+  upload_format_ = attributes_.format_;
+  switch (attributes_.internal_format_) {
+  case GL_RGBA:
+  case GL_RGBA8:
+    sized_format = GL_RGBA8;
+    break;
+  case GL_RGB:
+  case GL_RGB8:
+    sized_format = GL_RGB8;
+    break;
+  case GL_LUMINANCE:
+    sized_format = GL_R8;
+    upload_format_ = GL_RED;
+    swizzle[1] = swizzle[2] = GL_RED;
+    swizzle[3] = GL_ONE;
+    break;
+  case GL_LUMINANCE_ALPHA:
+    sized_format = GL_RG8;
+    upload_format_ = GL_RG;
+    swizzle[1] = swizzle[2] = GL_RED;
+    swizzle[3] = GL_GREEN;
+    break;
+  case GL_ALPHA:
+    sized_format = GL_R8;
+    upload_format_ = GL_RED;
+    swizzle[0] = swizzle[1] = swizzle[2] = GL_ZERO;
+    swizzle[3] = GL_RED;
+    break;
+  default:
+    return false;
+  }
+  glTexStorage2D(attributes_.target_, 1, sized_format, gl_width(width_), height_);
+  glTexParameteri(attributes_.target_, GL_TEXTURE_SWIZZLE_R, swizzle[0]);
+  glTexParameteri(attributes_.target_, GL_TEXTURE_SWIZZLE_G, swizzle[1]);
+  glTexParameteri(attributes_.target_, GL_TEXTURE_SWIZZLE_B, swizzle[2]);
+  glTexParameteri(attributes_.target_, GL_TEXTURE_SWIZZLE_A, swizzle[3]);
+  return true;
+}
+
 void Texture::destroy_texture() {
   if (texture_ != 0 && has_gen_tex_) {
     glDeleteTextures(1, &texture_);
@@ -131,8 +361,8 @@ GLuint Texture::get_texture() {
     pixel_lock_.lock();
 
     glBindTexture(attributes_.target_, texture_);
-    glTexSubImage2D(attributes_.target_, 0, 0, 0, width_, height_,
-            attributes_.format_, attributes_.type_, pixel_buffer_);
+    glTexSubImage2D(attributes_.target_, 0, 0, 0, content_width_, content_height_,
+            upload_format_, attributes_.type_, pixel_buffer_);
     glBindTexture(attributes_.target_, 0);
     free(pixel_buffer_);
     pixel_buffer_ = nullptr;
@@ -30,6 +30,7 @@
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <poll.h>
 #include <unistd.h>
 
 #ifdef __cplusplus
@@ -49,8 +50,11 @@ static int xioctl(int fd, int request, void *arg) {
 }
 
 v4l2_device_t* v4l2_create_device(const char* device_name) {
-  v4l2_device_t* device = (v4l2_device_t*)malloc(sizeof(v4l2_device_t));
+  v4l2_device_t* device = (v4l2_device_t*)calloc(1, sizeof(v4l2_device_t));
   strncpy(device->name_, device_name, sizeof(device->name_));
+  device->fd_ = -1;
+  device->max_borrowed_ = 2;
+  device->req_buffers_ = V4L2_DEFAULT_BUFFERS;
   return device;
 }
 
@@ -58,6 +62,40 @@ void v4l2_destroy_device(v4l2_device_t* device) {
   free(device);
 }
 
+int v4l2_probe_device(v4l2_device_t* device) {
+  int fd = open(device->name_, O_RDWR | O_NONBLOCK, 0);
+  if (-1 == fd) {
+    return V4L2_STATUS_ERROR;
+  }
+
+  int res = V4L2_STATUS_ERROR;
+  struct v4l2_capability cap;
+  CLEAR(cap);
+  if (0 == xioctl(fd, VIDIOC_QUERYCAP, &cap)) {
+    // metadata nodes share capabilities with their video node, check the node itself
+    unsigned int caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps : cap.capabilities;
+    if ((caps & V4L2_CAP_VIDEO_CAPTURE) && (caps & V4L2_CAP_STREAMING)) {
+      strncpy(device->description_, (char *)cap.card, sizeof(device->description_) - 1);
+      struct v4l2_format fmt;
+      CLEAR(fmt);
+      fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+      if (0 == xioctl(fd, VIDIOC_G_FMT, &fmt)) {
+        device->format_.width_ = fmt.fmt.pix.width;
+        device->format_.height_ = fmt.fmt.pix.height;
+        device->format_.pixel_format_ = fmt.fmt.pix.pixelformat;
+        device->format_.bytes_per_line_ = fmt.fmt.pix.bytesperline;
+        device->format_.colorspace_ = fmt.fmt.pix.colorspace;
+        device->format_.ycbcr_enc_ = fmt.fmt.pix.ycbcr_enc;
+        device->format_.quantization_ = fmt.fmt.pix.quantization;
+        res = V4L2_STATUS_OK;
+      }
+    }
+  }
+  close(fd);
+
+  return res;
+}
+
 int v4l2_open_device(v4l2_device_t* device) {
   struct stat st;
   if (-1 == stat(device->name_, &st)) {
@@ -94,7 +132,7 @@ int v4l2_open_device(v4l2_device_t* device) {
     fprintf(stderr, "Error: %s does not support streaming\n", device->name_);
     return V4L2_STATUS_ERROR;
   }
-  strncpy(device->description_, (char *)cap.card, strlen(device->description_));
+  strncpy(device->description_, (char *)cap.card, sizeof(device->description_) - 1);
 
   struct v4l2_crop crop;
   struct v4l2_cropcap cropcap;
@@ -106,24 +144,22 @@ int v4l2_open_device(v4l2_device_t* device) {
     xioctl(device->fd_, VIDIOC_S_CROP, &crop);
   }
 
-  struct v4l2_format fmt;
-  CLEAR(fmt);
-  fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  if (device->format_.width_ > 0 && device->format_.height_ > 0) {
-    fmt.fmt.pix.width       = device->format_.width_;
-    fmt.fmt.pix.height      = device->format_.height_;
-    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
-    fmt.fmt.pix.field       = V4L2_FIELD_ANY;
-    if (-1 == xioctl(device->fd_, VIDIOC_S_FMT, &fmt)) {
-      fprintf(stderr, "Error setting format on device: %s\n", device->name_);
-    }
+  // keep what driver has for the fields not requested
+  v4l2_format_t format = device->format_;
+  if (format.width_ > 0 && format.height_ > 0) {
+    v4l2_set_format(device, &format);
+  } else if (format.pixel_format_ || format.fps_) {
+    v4l2_get_format(device, &format);
+    format.pixel_format_ = device->format_.pixel_format_ ? device->format_.pixel_format_ : format.pixel_format_;
+    format.fps_ = device->format_.fps_;
+    v4l2_set_format(device, &format);
   }
   v4l2_get_format(device, &device->format_);
 
   //init buffer
   struct v4l2_requestbuffers req;
   CLEAR(req);
-  req.count = 4;
+  req.count = device->req_buffers_ > 0 ? device->req_buffers_ : V4L2_DEFAULT_BUFFERS;
   req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
   req.memory = V4L2_MEMORY_MMAP;
   if (-1 == xioctl(device->fd_, VIDIOC_REQBUFS, &req)) {
@@ -157,6 +193,7 @@ int v4l2_open_device(v4l2_device_t* device) {
     }
     
     device->buffers_[i].length_ = buf.length;
+    device->buffers_[i].dmabuf_fd_ = -1;
     device->buffers_[i].start_ = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, device->fd_, buf.m.offset);
     
     if (MAP_FAILED == device->buffers_[i].start_) {
@@ -171,40 +208,71 @@ int v4l2_open_device(v4l2_device_t* device) {
 
 int v4l2_close_device(v4l2_device_t *device) {
   for (unsigned int i = 0; i < device->num_buffers_; i++) {
+    if (device->buffers_[i].dmabuf_fd_ >= 0) {
+      close(device->buffers_[i].dmabuf_fd_);
+      device->buffers_[i].dmabuf_fd_ = -1;
+    }
     if (-1 == munmap(device->buffers_[i].start_, device->buffers_[i].length_)) {
       fprintf(stderr, "Unable to unmap buffers on %s\n", device->name_);
       return V4L2_STATUS_ERROR;
     }
   }
   
+  free(device->buffers_);
+  device->buffers_ = NULL;
+  device->num_buffers_ = 0;
+  
   if (-1 == close(device->fd_)) {
     fprintf(stderr, "Unable to close device: %s\n", device->name_);
     return V4L2_STATUS_ERROR;
   }
+  device->fd_ = -1;
   
   return V4L2_STATUS_OK;
 }
 
 int v4l2_set_format(v4l2_device_t* device, v4l2_format_t* format) {
   struct v4l2_format fmt;
-  
+  CLEAR(fmt);
   fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  if (-1 == xioctl(device->fd_, VIDIOC_G_FMT, &fmt)) {
+    fprintf(stderr, "Could not get format on device: %s\n", device->name_);
+    return V4L2_STATUS_ERROR;
+  }
+
   fmt.fmt.pix.width = format->width_;
   fmt.fmt.pix.height = format->height_;
-  fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+  if (format->pixel_format_) fmt.fmt.pix.pixelformat = format->pixel_format_;
   fmt.fmt.pix.field = V4L2_FIELD_ANY;
+  fmt.fmt.pix.bytesperline = 0; // let driver compute it for the new format
+  fmt.fmt.pix.sizeimage = 0;
   
   if (-1 == xioctl(device->fd_, VIDIOC_S_FMT, &fmt)) {
     fprintf(stderr, "Could not set format[%dx%d] on device: %s\n",
         format->width_, format->height_, device->name_);
     return V4L2_STATUS_ERROR;
-  } else {
-    return V4L2_STATUS_OK;
   }
+
+  if (format->fps_ > 0) {
+    struct v4l2_streamparm parm;
+    CLEAR(parm);
+    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (0 == xioctl(device->fd_, VIDIOC_G_PARM, &parm)
+     && (parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME)) {
+      parm.parm.capture.timeperframe.numerator = 1;
+      parm.parm.capture.timeperframe.denominator = format->fps_;
+      if (-1 == xioctl(device->fd_, VIDIOC_S_PARM, &parm)) {
+        fprintf(stderr, "Could not set frame rate[%u] on device: %s\n", format->fps_, device->name_);
+      }
+    }
+  }
+  
+  return V4L2_STATUS_OK;
 }
 
 int v4l2_get_format(v4l2_device_t* device, v4l2_format_t* format) {
   struct v4l2_format fmt;
+  CLEAR(fmt);
   fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
   if (-1 == xioctl(device->fd_, VIDIOC_G_FMT, &fmt)) {
     fprintf(stderr, "Could not get format on device: %s\n", device->name_);
@@ -213,14 +281,87 @@ int v4l2_get_format(v4l2_device_t* device, v4l2_format_t* format) {
   format->width_ = fmt.fmt.pix.width;
   format->height_ = fmt.fmt.pix.height;
   format->pixel_format_ = fmt.fmt.pix.pixelformat;
+  format->bytes_per_line_ = fmt.fmt.pix.bytesperline;
+  format->colorspace_ = fmt.fmt.pix.colorspace;
+  format->ycbcr_enc_ = fmt.fmt.pix.ycbcr_enc;
+  format->quantization_ = fmt.fmt.pix.quantization;
+  format->fps_ = 0;
+
+  struct v4l2_streamparm parm;
+  CLEAR(parm);
+  parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  if (0 == xioctl(device->fd_, VIDIOC_G_PARM, &parm)
+   && parm.parm.capture.timeperframe.numerator > 0) {
+    format->fps_ = parm.parm.capture.timeperframe.denominator / parm.parm.capture.timeperframe.numerator;
+  }
   
   return V4L2_STATUS_OK;
 }
 
+static unsigned int max_frame_rate(int fd, unsigned int pixel_format, unsigned int width, unsigned int height) {
+  struct v4l2_frmivalenum ival;
+  unsigned int fps = 0;
+  CLEAR(ival);
+  ival.pixel_format = pixel_format;
+  ival.width = width;
+  ival.height = height;
+  for (ival.index = 0; 0 == xioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &ival); ival.index++) {
+    // stepwise intervals report the shortest one in min
+    struct v4l2_fract* interval = ival.type == V4L2_FRMIVAL_TYPE_DISCRETE ? &ival.discrete : &ival.stepwise.min;
+    if (interval->numerator > 0 && interval->denominator / interval->numerator > fps) {
+      fps = interval->denominator / interval->numerator;
+    }
+    if (ival.type != V4L2_FRMIVAL_TYPE_DISCRETE) break;
+  }
+  return fps;
+}
+
+static int add_mode(v4l2_mode_t* modes, int max_modes, int count, unsigned int pixel_format,
+                    unsigned int width, unsigned int height, unsigned int fps) {
+  if (count < max_modes) {
+    modes[count].pixel_format_ = pixel_format;
+    modes[count].width_ = width;
+    modes[count].height_ = height;
+    modes[count].fps_ = fps;
+  }
+  return count + 1;
+}
+
+int v4l2_enum_modes(v4l2_device_t* device, v4l2_mode_t* modes, int max_modes) {
+  int fd = device->fd_;
+  if (fd < 0) {
+    fd = open(device->name_, O_RDWR | O_NONBLOCK, 0);
+    if (-1 == fd) return V4L2_STATUS_ERROR;
+  }
+
+  int count = 0;
+  struct v4l2_fmtdesc desc;
+  CLEAR(desc);
+  desc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  for (desc.index = 0; 0 == xioctl(fd, VIDIOC_ENUM_FMT, &desc); desc.index++) {
+    struct v4l2_frmsizeenum size;
+    CLEAR(size);
+    size.pixel_format = desc.pixelformat;
+    for (size.index = 0; 0 == xioctl(fd, VIDIOC_ENUM_FRAMESIZES, &size); size.index++) {
+      if (size.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+        count = add_mode(modes, max_modes, count, desc.pixelformat, size.discrete.width, size.discrete.height,
+                         max_frame_rate(fd, desc.pixelformat, size.discrete.width, size.discrete.height));
+        continue;
+      }
+      // continuous/stepwise ranges are reported by their bounds only
+      count = add_mode(modes, max_modes, count, desc.pixelformat, size.stepwise.max_width, size.stepwise.max_height,
+                       max_frame_rate(fd, desc.pixelformat, size.stepwise.max_width, size.stepwise.max_height));
+      count = add_mode(modes, max_modes, count, desc.pixelformat, size.stepwise.min_width, size.stepwise.min_height,
+                       max_frame_rate(fd, desc.pixelformat, size.stepwise.min_width, size.stepwise.min_height));
+      break;
+    }
+  }
+
+  if (fd != device->fd_) close(fd);
+  return count;
+}
+
 int v4l2_start_capture(v4l2_device_t *device) {
-  //allocate data buffer
-  device->data_ = (unsigned char*)malloc(device->buffers_[0].length_);
-  
   //queue buffers
   for (unsigned int i = 0; i < device->num_buffers_; i++) {
     struct v4l2_buffer buf;
@@ -248,6 +389,8 @@ int v4l2_start_capture(v4l2_device_t *device) {
 int v4l2_stop_capture(v4l2_device_t *device) {
   //free data buffer
   free(device->data_);
+  device->data_ = NULL;
+  device->num_borrowed_ = 0; // streamoff takes back all buffers
   
   //turn off stream
   enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -260,6 +403,23 @@ int v4l2_stop_capture(v4l2_device_t *device) {
   return V4L2_STATUS_OK;
 }
 
+int v4l2_wait_frame(v4l2_device_t *device, int timeout_ms) {
+  struct pollfd fds;
+  fds.fd = device->fd_;
+  fds.events = POLLIN;
+  fds.revents = 0;
+
+  int r;
+  do {
+    r = poll(&fds, 1, timeout_ms);
+  } while (-1 == r && EINTR == errno);
+
+  if (-1 == r || (fds.revents & (POLLERR | POLLNVAL))) {
+    return V4L2_STATUS_ERROR;
+  }
+  return r == 0 ? V4L2_STATUS_TIMEOUT : V4L2_STATUS_OK;
+}
+
 int v4l2_grab_frame(v4l2_device_t *device) {
   struct v4l2_buffer frame_buffer;
   
@@ -271,7 +431,9 @@ int v4l2_grab_frame(v4l2_device_t *device) {
     return V4L2_STATUS_ERROR;
   }
   
-  memcpy(device->data_, device->buffers_[frame_buffer.index].start_, frame_buffer.bytesused);
+  //data buffer is only needed by the copying path, zero-copy consumers never touch it
+  if (!device->data_) device->data_ = (unsigned char*)malloc(device->buffers_[0].length_);
+  if (device->data_) memcpy(device->data_, device->buffers_[frame_buffer.index].start_, frame_buffer.bytesused);
 
   //requeue buffer
   if (-1 == xioctl(device->fd_, VIDIOC_QBUF, &frame_buffer)) {
@@ -283,7 +445,94 @@ int v4l2_grab_frame(v4l2_device_t *device) {
 }
 
 void v4l2_copy_frame(v4l2_device_t *device, unsigned char* dest) {
-  memcpy(dest, device->data_, device->buffers_[0].length_);
+  if (device->data_) memcpy(dest, device->data_, device->buffers_[0].length_);
+}
+
+int v4l2_borrow_frame(v4l2_device_t *device, v4l2_frame_t* frame) {
+  struct v4l2_buffer frame_buffer;
+
+  // keep enough buffers queued for the driver to go on capturing
+  if (device->num_borrowed_ >= device->max_borrowed_
+   || device->num_borrowed_ + 1 >= device->num_buffers_) {
+    return V4L2_STATUS_AGAIN;
+  }
+
+  CLEAR(frame_buffer);
+  frame_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  frame_buffer.memory = V4L2_MEMORY_MMAP;
+  if (-1 == xioctl(device->fd_, VIDIOC_DQBUF, &frame_buffer)) {
+    return EAGAIN == errno ? V4L2_STATUS_AGAIN : V4L2_STATUS_ERROR;
+  }
+
+  frame->index_ = frame_buffer.index;
+  frame->data_ = (unsigned char*)device->buffers_[frame_buffer.index].start_;
+  frame->length_ = frame_buffer.bytesused;
+  frame->dmabuf_fd_ = device->buffers_[frame_buffer.index].dmabuf_fd_;
+  frame->timestamp_us_ = (long long) frame_buffer.timestamp.tv_sec * 1000000 + frame_buffer.timestamp.tv_usec;
+  device->num_borrowed_++;
+
+  return V4L2_STATUS_OK;
+}
+
+int v4l2_drop_frame(v4l2_device_t *device) {
+  struct v4l2_buffer frame_buffer;
+
+  CLEAR(frame_buffer);
+  frame_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  frame_buffer.memory = V4L2_MEMORY_MMAP;
+  if (-1 == xioctl(device->fd_, VIDIOC_DQBUF, &frame_buffer)) {
+    return EAGAIN == errno ? V4L2_STATUS_AGAIN : V4L2_STATUS_ERROR;
+  }
+  if (-1 == xioctl(device->fd_, VIDIOC_QBUF, &frame_buffer)) {
+    fprintf(stderr, "Could not requeue buffer on device: %s\n", device->name_);
+    return V4L2_STATUS_ERROR;
+  }
+
+  return V4L2_STATUS_OK;
+}
+
+int v4l2_release_frame(v4l2_device_t *device, v4l2_frame_t* frame) {
+  struct v4l2_buffer frame_buffer;
+
+  if (frame->index_ < 0 || (unsigned int)frame->index_ >= device->num_buffers_) {
+    return V4L2_STATUS_ERROR;
+  }
+
+  CLEAR(frame_buffer);
+  frame_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  frame_buffer.memory = V4L2_MEMORY_MMAP;
+  frame_buffer.index = frame->index_;
+  if (-1 == xioctl(device->fd_, VIDIOC_QBUF, &frame_buffer)) {
+    fprintf(stderr, "Could not requeue buffer on device: %s\n", device->name_);
+    return V4L2_STATUS_ERROR;
+  }
+
+  frame->index_ = -1;
+  frame->data_ = NULL;
+  frame->length_ = 0;
+  frame->dmabuf_fd_ = -1;
+  if (device->num_borrowed_ > 0) device->num_borrowed_--;
+
+  return V4L2_STATUS_OK;
+}
+
+int v4l2_export_buffers(v4l2_device_t *device) {
+  for (unsigned int i = 0; i < device->num_buffers_; i++) {
+    if (device->buffers_[i].dmabuf_fd_ >= 0) continue;
+
+    struct v4l2_exportbuffer expbuf;
+    CLEAR(expbuf);
+    expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    expbuf.index = i;
+    expbuf.flags = O_RDONLY | O_CLOEXEC;
+    if (-1 == xioctl(device->fd_, VIDIOC_EXPBUF, &expbuf)) {
+      fprintf(stderr, "Unable to export buffers on device: %s\n", device->name_);
+      return V4L2_STATUS_ERROR;
+    }
+    device->buffers_[i].dmabuf_fd_ = expbuf.fd;
+  }
+
+  return V4L2_STATUS_OK;
 }
 
 #ifdef __cplusplus
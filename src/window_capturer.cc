@@ -54,6 +54,97 @@ static DeviceInfo create_device(Display* display, XID& window)
   return dev;
 }
 
+static const int MAX_PENDING_DAMAGES = 64;
+static const int MAX_DIRTY_RECTS = 16;
+
+static XImage* create_shm_image(Display* display, XShmSegmentInfo* shm_info, int width, int height)
+{
+  int scr = XDefaultScreen(display);
+  XImage* image = XShmCreateImage(display, DefaultVisual(display, scr),
+                                  DefaultDepth(display, scr), ZPixmap, NULL,
+                                  shm_info, width, height);
+  shm_info->shmid = shmget(IPC_PRIVATE, image->bytes_per_line * image->height, IPC_CREAT | 0777);
+  shm_info->readOnly = false;
+  shm_info->shmaddr = image->data = (char*) shmat(shm_info->shmid, 0, 0);
+  XShmAttach(display, shm_info);
+  return image;
+}
+
+static void destroy_shm_image(Display* display, XShmSegmentInfo* &shm_info, XImage* &image)
+{
+  if(shm_info) {
+    shmdt(shm_info->shmaddr);
+    shmctl(shm_info->shmid, IPC_RMID, 0);
+    XShmDetach(display, shm_info);
+    delete shm_info;
+    shm_info = nullptr;
+  }
+  if(image) {
+    XDestroyImage(image);
+    image = nullptr;
+  }
+}
+
+static long rect_area(const Rect& rect)
+{
+  return (long) rect.width_ * rect.height_;
+}
+
+static Rect bounding_rect(const Rect& a, const Rect& b)
+{
+  Rect res;
+  res.x_ = std::min(a.x_, b.x_);
+  res.y_ = std::min(a.y_, b.y_);
+  res.width_ = std::max(a.x_ + a.width_, b.x_ + b.width_) - res.x_;
+  res.height_ = std::max(a.y_ + a.height_, b.y_ + b.height_) - res.y_;
+  return res;
+}
+
+static bool clip_rect(Rect& rect, int width, int height)
+{
+  int right = std::min(rect.x_ + rect.width_, width);
+  int bottom = std::min(rect.y_ + rect.height_, height);
+  rect.x_ = std::max(rect.x_, 0);
+  rect.y_ = std::max(rect.y_, 0);
+  rect.width_ = right - rect.x_;
+  rect.height_ = bottom - rect.y_;
+  return rect.width_ > 0 && rect.height_ > 0;
+}
+
+/**
+ * @brief merge_rects, clip damaged rectangles into frame and join the ones whose
+ *        bounding box doesn't waste much more area than themselves
+ */
+static void merge_rects(std::vector<Rect>& rects, int width, int height)
+{
+  size_t count = 0;
+  for (size_t i = 0; i < rects.size(); i++) {
+    if (clip_rect(rects[i], width, height)) rects[count++] = rects[i];
+  }
+  rects.resize(count);
+
+  bool is_merged = true;
+  while (is_merged) {
+    is_merged = false;
+    for (size_t i = 0; i < rects.size(); i++) {
+      for (size_t j = i + 1; j < rects.size(); j++) {
+        Rect merged = bounding_rect(rects[i], rects[j]);
+        if (rect_area(merged) * 4 > (rect_area(rects[i]) + rect_area(rects[j])) * 5) continue;
+        rects[i] = merged;
+        rects.erase(rects.begin() + j);
+        j = i;
+        is_merged = true;
+      }
+    }
+  }
+
+  if (rects.size() > MAX_DIRTY_RECTS) {
+    Rect merged = rects[0];
+    for (const Rect& rect : rects) merged = bounding_rect(merged, rect);
+    rects.assign(1, merged);
+  }
+}
+
 WindowCapturer::WindowCapturer()
 {
   cur_dev_.dev_id_ = 0;
@@ -115,19 +206,23 @@ int WindowCapturer::bind_device(DeviceInfo dev)
     cur_dev_.height_ = height;
   }
 
-  int scr = XDefaultScreen(cur_display_);
   shm_info_ = new XShmSegmentInfo();
-  cur_image_ = XShmCreateImage(cur_display_, DefaultVisual(cur_display_, scr),
-                                DefaultDepth(cur_display_, scr), ZPixmap, NULL,
-                                shm_info_, cur_dev_.width_, cur_dev_.height_);
-  shm_info_->shmid = shmget(IPC_PRIVATE, cur_image_->bytes_per_line * cur_image_->height, IPC_CREAT | 0777);
-  shm_info_->readOnly = false;
-  shm_info_->shmaddr = cur_image_->data = (char*) shmat(shm_info_->shmid, 0, 0);
-  XShmAttach(cur_display_, shm_info_);
+  cur_image_ = create_shm_image(cur_display_, shm_info_, cur_dev_.width_, cur_dev_.height_);
 
   // force preserve an off-screen storage for window even if it's in the background
   XCompositeRedirectWindow(cur_display_, cur_dev_.dev_id_, CompositeRedirectAutomatic);
 
+  // moving/resizing doesn't always damage the window, watch its geometry as well
+  if (!is_window_fixed) {
+    XSelectInput(cur_display_, (Window)(cur_dev_.dev_id_), StructureNotifyMask);
+  }
+  is_content_dirty_ = true;
+  is_geometry_dirty_ = !is_window_fixed;
+  Rect frame;
+  frame.width_ = cur_dev_.width_;
+  frame.height_ = cur_dev_.height_;
+  damage_rects_.assign(1, frame);
+
   // register notify-receiver for content updating event(damage) of window
   if (!XDamageQueryExtension(cur_display_, &damage_event_base_, &damage_error_base_)) {
     damage_event_base_ = 0;
@@ -147,39 +242,52 @@ int WindowCapturer::unbind_device()
   if (cur_dev_.dev_id_) {
     XCompositeUnredirectWindow(cur_display_, cur_dev_.dev_id_, CompositeRedirectAutomatic);
   }
-  if(shm_info_) {
-    shmdt(shm_info_->shmaddr);
-    shmctl(shm_info_->shmid, IPC_RMID, 0);
-    XShmDetach(cur_display_, shm_info_);
-    delete shm_info_;
-    shm_info_ = nullptr;
-  }
-  if(cur_image_) {
-    XDestroyImage(cur_image_);
-    cur_image_ = nullptr;
-  }
+  destroy_shm_image(cur_display_, shm_info_, cur_image_);
+  destroy_shm_image(cur_display_, patch_shm_info_, patch_image_);
   if(cur_display_) {
     XCloseDisplay(cur_display_);
     cur_display_ = 0;
   }
   cur_dev_.dev_id_ = 0;
+  damage_rects_.clear();
   return 0;
 }
 
-bool WindowCapturer::is_window_redrawed()
+void WindowCapturer::process_pending_events()
 {
-  if (!damage_event_base_) return true;
   int events_to_process = XPending(cur_display_);
   XEvent e;
   for (int i = 0; i < events_to_process; i++) {
     XNextEvent(cur_display_, &e);
-    if (e.type == damage_event_base_ + XDamageNotify) {
-      if (((XDamageNotifyEvent *)&e)->damage == damage_handle_) {
-        return true;
+    if (damage_event_base_ && e.type == damage_event_base_ + XDamageNotify) {
+      XDamageNotifyEvent* damage = (XDamageNotifyEvent *)&e;
+      if (damage->damage == damage_handle_) {
+        is_content_dirty_ = true;
+        // damaged area is relative to the drawable, the root window for screens
+        Rect rect;
+        rect.x_ = damage->area.x - (is_window_fixed ? cur_dev_.pos_x_ : 0);
+        rect.y_ = damage->area.y - (is_window_fixed ? cur_dev_.pos_y_ : 0);
+        rect.width_ = damage->area.width;
+        rect.height_ = damage->area.height;
+        damage_rects_.push_back(rect);
       }
+    } else if (e.type == ConfigureNotify || e.type == DestroyNotify) {
+      is_geometry_dirty_ = true;
     }
   }
-  return false;
+  if (!damage_event_base_) is_content_dirty_ = true;
+
+  if (damage_rects_.size() > MAX_PENDING_DAMAGES) {
+    merge_rects(damage_rects_, cur_dev_.width_, cur_dev_.height_);
+  }
+}
+
+bool WindowCapturer::is_window_redrawed()
+{
+  bool is_redrawed = is_content_dirty_;
+  is_content_dirty_ = false;
+  damage_rects_.clear();
+  return is_redrawed;
 }
 
 int WindowCapturer::resize_window_internal(int x, int y, int width, int height)
@@ -199,35 +307,130 @@ int WindowCapturer::resize_window_internal(int x, int y, int width, int height)
   return is_size_changed;
 }
 
-int WindowCapturer::grab_frame(unsigned char *&buffer)
+int WindowCapturer::update_geometry()
 {
-  if (!cur_display_) return 0;
+  is_geometry_dirty_ = false;
+  if (is_window_fixed) return 0;
+
   Window tmp_wnd;
   int x, y, pos_x, pos_y;
   unsigned int width, height, border, depth;
-  do {
-    if (!is_window_fixed) {
-      if(XGetGeometry(cur_display_, (Window)(cur_dev_.dev_id_),
-                      &tmp_wnd, &x, &y, &width, &height, &border, &depth) == 0) {
-        return -1; // window might not be valid any more
-      }
-      XTranslateCoordinates(cur_display_, (Window)(cur_dev_.dev_id_),
-                          XDefaultRootWindow(cur_display_), x, y, &pos_x, &pos_y, &tmp_wnd);
-      // if window size changed, rebuild memory mapping staffs
-      resize_window_internal(pos_x, pos_y, width, height);
-      if(!XShmGetImage(cur_display_, (Window)(cur_dev_.dev_id_), cur_image_, 0, 0, AllPlanes)) {
-        // TODO:: log error fetch buffer failed
-        return -1;
-      }
-    } else {
-      if(!XShmGetImage(cur_display_, (Window)(cur_dev_.dev_id_), cur_image_,
-                       cur_dev_.pos_x_, cur_dev_.pos_y_, AllPlanes)) {
-        // TODO:: log error fetch buffer failed
-        return -1;
-      }
+  if(XGetGeometry(cur_display_, (Window)(cur_dev_.dev_id_),
+                  &tmp_wnd, &x, &y, &width, &height, &border, &depth) == 0) {
+    return -1; // window might not be valid any more
+  }
+  XTranslateCoordinates(cur_display_, (Window)(cur_dev_.dev_id_),
+                        XDefaultRootWindow(cur_display_), x, y, &pos_x, &pos_y, &tmp_wnd);
+  // if window size changed, rebuild memory mapping staffs
+  if (resize_window_internal(pos_x, pos_y, width, height)) {
+    is_geometry_dirty_ = false;
+    return 1;
+  }
+  return 0;
+}
+
+int WindowCapturer::fetch_image()
+{
+  int x = is_window_fixed ? cur_dev_.pos_x_ : 0;
+  int y = is_window_fixed ? cur_dev_.pos_y_ : 0;
+  if(!XShmGetImage(cur_display_, (Window)(cur_dev_.dev_id_), cur_image_, x, y, AllPlanes)) {
+    // TODO:: log error fetch buffer failed
+    return -1;
+  }
+  return 0;
+}
+
+int WindowCapturer::fetch_image(const Rect& rect)
+{
+  if (!patch_image_) {
+    patch_shm_info_ = new XShmSegmentInfo();
+    patch_image_ = create_shm_image(cur_display_, patch_shm_info_, cur_dev_.width_, cur_dev_.height_);
+  }
+  // server packs rows of the sub-image tightly, fetch into the patch then scatter into frame
+  int scr = XDefaultScreen(cur_display_);
+  XImage* patch = XShmCreateImage(cur_display_, DefaultVisual(cur_display_, scr),
+                                  DefaultDepth(cur_display_, scr), ZPixmap, patch_image_->data,
+                                  patch_shm_info_, rect.width_, rect.height_);
+  int x = rect.x_ + (is_window_fixed ? cur_dev_.pos_x_ : 0);
+  int y = rect.y_ + (is_window_fixed ? cur_dev_.pos_y_ : 0);
+  if(!XShmGetImage(cur_display_, (Window)(cur_dev_.dev_id_), patch, x, y, AllPlanes)) {
+    XDestroyImage(patch);
+    return -1;
+  }
+  int pixel_size = cur_image_->bits_per_pixel >> 3;
+  for (int i = 0; i < rect.height_; i++) {
+    memcpy(cur_image_->data + (rect.y_ + i) * cur_image_->bytes_per_line + rect.x_ * pixel_size,
+           patch->data + i * patch->bytes_per_line, rect.width_ * pixel_size);
+  }
+  XDestroyImage(patch);
+  return 0;
+}
+
+int WindowCapturer::grab_frame(unsigned char *&buffer)
+{
+  if (!cur_display_) return 0;
+  // check damage before fetching, updates arrived after this point belong to the next frame
+  process_pending_events();
+  bool is_gated = is_damage_gated_ && damage_event_base_;
+  if (is_gated && !is_content_dirty_ && !is_geometry_dirty_) {
+    skipped_frames_++;
+    buffer = (unsigned char *)cur_image_->data;
+    return 0;
+  }
+  bool is_redrawed = is_window_redrawed();
+
+  if (!is_gated || is_geometry_dirty_) {
+    int state = update_geometry();
+    if (state < 0) return -1;
+    if (state > 0) {
+      // capturer has been rebound, the whole frame is new content
+      is_redrawed = true;
+      is_window_redrawed();
     }
-    break;
-  } while (true);
+  }
+  if (fetch_image() < 0) return -1;
+
+  grabbed_frames_++;
+  buffer = (unsigned char *)cur_image_->data;
+  if (!is_redrawed) return 0;
+  int len = cur_dev_.width_ * cur_dev_.height_ * sizeof(int);
+  // the server can only write into shm, this is the one client side copy of the frame
+  buffer = deliver_to_provider(buffer, len);
+  return len;
+}
+
+int WindowCapturer::grab_frame(unsigned char *&buffer, std::vector<Rect>& dirty)
+{
+  dirty.clear();
+  if (!cur_display_) return 0;
+  // without damage rectangles there is nothing better than the whole frame
+  if (!damage_event_base_) return ICaptureDevice::grab_frame(buffer, dirty);
+
+  process_pending_events();
+  buffer = (unsigned char *)cur_image_->data;
+  if (!is_content_dirty_ && !is_geometry_dirty_) {
+    skipped_frames_++;
+    return 0;
+  }
+  if (is_geometry_dirty_ && update_geometry() < 0) return -1;
   buffer = (unsigned char *)cur_image_->data;
-  return is_window_redrawed() ? cur_dev_.width_ * cur_dev_.height_ * sizeof(int) : 0;
+
+  is_content_dirty_ = false;
+  dirty.swap(damage_rects_);
+  merge_rects(dirty, cur_dev_.width_, cur_dev_.height_);
+  if (dirty.empty()) return 0; // only moved
+
+  long dirty_area = 0;
+  for (const Rect& rect : dirty) dirty_area += rect_area(rect);
+  if (dirty_area * 2 > (long) cur_dev_.width_ * cur_dev_.height_) {
+    // one request for the whole frame is cheaper than lots of big patches
+    if (fetch_image() < 0) return -1;
+  } else {
+    for (const Rect& rect : dirty) {
+      if (fetch_image(rect) < 0) return -1;
+    }
+  }
+
+  grabbed_frames_++;
+  return dirty_area * sizeof(int);
 }